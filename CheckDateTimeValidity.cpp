@@ -1,5 +1,13 @@
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <span>
 #include <stdexcept>
+#include <string_view>
+#include <vector>
 
 enum class TimeUnit {
     Hour,
@@ -7,6 +15,21 @@ enum class TimeUnit {
     Second
 };
 
+// Дни в месяцах: первые 12 значений для обычного года, следующие 12 - для високосного
+constexpr std::array<int, 24> DAYS_IN_MONTH = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
+    31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+constexpr bool IsLeapYear(int year) noexcept {
+    return (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0);
+}
+
+// Число дней в месяце. Месяц должен быть уже проверен
+constexpr int DaysInMonth(int year, int month) noexcept {
+    return DAYS_IN_MONTH[IsLeapYear(year) * 12 + month - 1];
+}
+
 // Проверка, является ли указанный год допустимым
 void CheckYearValidity(int year) {
     if (year < 1 || year > 9999) {
@@ -23,10 +46,7 @@ void CheckMonthValidity(int month) {
 
 // Проверка, является ли указанный день допустимым для указанного года и месяца
 void CheckDayValidity(int year, int month, int day) {
-    const bool isLeapYear = (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0);
-    const std::array<int, 12> daysInMonth = { 31, 28 + isLeapYear, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
-
-    if (day < 1 || day > daysInMonth[month - 1]) {
+    if (day < 1 || day > DaysInMonth(year, month)) {
         throw std::domain_error("Day is out of range for the given year and month");
     }
 }
@@ -60,3 +80,754 @@ void CheckDateTimeValidity(const DateTime& dt) {
     CheckTimeUnitValidity(dt.minute, TimeUnit::Minute);
     CheckTimeUnitValidity(dt.second, TimeUnit::Second);
 }
+
+//------------------------------------------------------
+// Проверки без исключений. Те же правила, но ошибка возвращается как значение, поэтому
+// функции constexpr и noexcept: их можно вызывать в static_assert, а на горячем пути нет раскрутки стека
+
+// Какое поле и почему не прошло проверку
+enum class DateTimeError : uint8_t {
+    YearTooSmall,
+    YearTooLarge,
+    MonthTooSmall,
+    MonthTooLarge,
+    DayTooSmall,
+    DayTooLargeForMonth,
+    HourTooSmall,
+    HourTooLarge,
+    MinuteTooSmall,
+    MinuteTooLarge,
+    SecondTooSmall,
+    SecondTooLarge,
+    InvalidFormat // Строка не в виде YYYY-MM-DDTHH:MM:SS
+};
+
+// Текст ошибки совпадает с сообщением соответствующего исключения
+constexpr std::string_view ErrorMessage(DateTimeError error) noexcept {
+    switch (error) {
+    case DateTimeError::YearTooSmall:
+    case DateTimeError::YearTooLarge:
+        return "Year is out of range";
+    case DateTimeError::MonthTooSmall:
+    case DateTimeError::MonthTooLarge:
+        return "Month is out of range";
+    case DateTimeError::DayTooSmall:
+    case DateTimeError::DayTooLargeForMonth:
+        return "Day is out of range for the given year and month";
+    case DateTimeError::InvalidFormat:
+        return "Date-time is not in YYYY-MM-DDTHH:MM:SS format";
+    default:
+        return "Time unit is out of range";
+    }
+}
+
+// Результат проверки в духе std::expected<void, DateTimeError>: либо успех, либо код ошибки
+class [[nodiscard]] DateTimeStatus {
+public:
+    constexpr DateTimeStatus() noexcept = default;
+    constexpr DateTimeStatus(DateTimeError error) noexcept;
+
+    constexpr bool has_value() const noexcept;
+    constexpr explicit operator bool() const noexcept;
+    // Вызывать только при has_value() == false
+    constexpr DateTimeError error() const noexcept;
+
+private:
+    bool has_error_ = false;
+    DateTimeError error_ = DateTimeError::YearTooSmall;
+};
+
+constexpr DateTimeStatus::DateTimeStatus(DateTimeError error) noexcept
+    : has_error_(true)
+    , error_(error) {
+}
+
+constexpr bool DateTimeStatus::has_value() const noexcept {
+    return !has_error_;
+}
+
+constexpr DateTimeStatus::operator bool() const noexcept {
+    return has_value();
+}
+
+constexpr DateTimeError DateTimeStatus::error() const noexcept {
+    return error_;
+}
+
+constexpr DateTimeStatus ValidateYear(int year) noexcept {
+    if (year < 1) {
+        return DateTimeError::YearTooSmall;
+    }
+    if (year > 9999) {
+        return DateTimeError::YearTooLarge;
+    }
+    return {};
+}
+
+constexpr DateTimeStatus ValidateMonth(int month) noexcept {
+    if (month < 1) {
+        return DateTimeError::MonthTooSmall;
+    }
+    if (month > 12) {
+        return DateTimeError::MonthTooLarge;
+    }
+    return {};
+}
+
+// Месяц должен быть уже проверен, как и в CheckDayValidity
+constexpr DateTimeStatus ValidateDay(int year, int month, int day) noexcept {
+    if (day < 1) {
+        return DateTimeError::DayTooSmall;
+    }
+    if (day > DaysInMonth(year, month)) {
+        return DateTimeError::DayTooLargeForMonth;
+    }
+    return {};
+}
+
+constexpr DateTimeStatus ValidateTimeUnit(int value, TimeUnit unit) noexcept {
+    switch (unit) {
+    case TimeUnit::Hour:
+        if (value < 0) {
+            return DateTimeError::HourTooSmall;
+        }
+        if (value > 23) {
+            return DateTimeError::HourTooLarge;
+        }
+        break;
+    case TimeUnit::Minute:
+        if (value < 0) {
+            return DateTimeError::MinuteTooSmall;
+        }
+        if (value > 59) {
+            return DateTimeError::MinuteTooLarge;
+        }
+        break;
+    case TimeUnit::Second:
+        if (value < 0) {
+            return DateTimeError::SecondTooSmall;
+        }
+        if (value > 59) {
+            return DateTimeError::SecondTooLarge;
+        }
+        break;
+    }
+    return {};
+}
+
+// Поля проверяются в том же порядке, что и в CheckDateTimeValidity, поэтому ошибка та же,
+// на которой бросила бы исключение версия с throw
+constexpr DateTimeStatus ValidateDateTime(int year, int month, int day, int hour, int minute, int second) noexcept {
+    if (const DateTimeStatus status = ValidateYear(year); !status) {
+        return status;
+    }
+    if (const DateTimeStatus status = ValidateMonth(month); !status) {
+        return status;
+    }
+    if (const DateTimeStatus status = ValidateDay(year, month, day); !status) {
+        return status;
+    }
+    if (const DateTimeStatus status = ValidateTimeUnit(hour, TimeUnit::Hour); !status) {
+        return status;
+    }
+    if (const DateTimeStatus status = ValidateTimeUnit(minute, TimeUnit::Minute); !status) {
+        return status;
+    }
+    return ValidateTimeUnit(second, TimeUnit::Second);
+}
+
+constexpr DateTimeStatus ValidateDateTime(const DateTime& dt) noexcept {
+    return ValidateDateTime(dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
+}
+
+static_assert(ValidateDateTime(2024, 2, 29, 23, 59, 59));
+static_assert(ValidateDateTime(2000, 2, 29, 0, 0, 0));
+static_assert(ValidateDateTime(1900, 2, 29, 0, 0, 0).error() == DateTimeError::DayTooLargeForMonth);
+static_assert(ValidateDateTime(0, 13, 0, 24, 60, 60).error() == DateTimeError::YearTooSmall);
+static_assert(ValidateDateTime(2024, 4, 31, 0, 0, 0).error() == DateTimeError::DayTooLargeForMonth);
+static_assert(ValidateDateTime(2024, 12, 31, 12, 60, 0).error() == DateTimeError::MinuteTooLarge);
+
+//------------------------------------------------------
+// Биты маски ошибок пакетной проверки: какое поле записи вышло за допустимые пределы.
+// У корректной записи маска равна нулю
+// Номера битов совпадают со сдвигами в DateTimeErrorMask
+enum DateTimeFieldBit : uint8_t {
+    YEAR_BIT = 1 << 0,
+    MONTH_BIT = 1 << 1,
+    DAY_BIT = 1 << 2,
+    HOUR_BIT = 1 << 3,
+    MINUTE_BIT = 1 << 4,
+    SECOND_BIT = 1 << 5
+};
+
+// Структура массивов: отдельный столбец на каждое поле, все столбцы одной длины
+struct DateTimeColumns {
+    std::span<const int> year;
+    std::span<const int> month;
+    std::span<const int> day;
+    std::span<const int> hour;
+    std::span<const int> minute;
+    std::span<const int> second;
+};
+
+// 1, если value лежит вне [min, max]. Одно беззнаковое сравнение вместо двух условий и без переполнения
+inline uint32_t IsOutOfRange(int value, int min, int max) noexcept {
+    return static_cast<uint32_t>(value) - static_cast<uint32_t>(min) > static_cast<uint32_t>(max - min);
+}
+
+// Маска ошибок одной записи. Только арифметика и выборка из таблицы, без ветвлений и выбора по условию,
+// поэтому компилятор векторизует цикл по столбцам (GCC 12, -O3, уже на базовом SSE2).
+// Правила те же, что в Check*Validity. День с некорректным месяцем проверяется по январю (до 31)
+inline uint8_t DateTimeErrorMask(int year, int month, int day, int hour, int minute, int second) noexcept {
+    const uint32_t month_error = IsOutOfRange(month, 1, 12);
+    const uint32_t is_leap_year = (year % 4 == 0) & ((year % 100 != 0) | (year % 400 == 0));
+    // При некорректном месяце маска обнуляет индекс
+    const uint32_t month_index = (static_cast<uint32_t>(month) - 1) & (month_error - 1);
+    const int days_in_month = DAYS_IN_MONTH[is_leap_year * 12 + month_index];
+
+    return static_cast<uint8_t>(
+        IsOutOfRange(year, 1, 9999)
+        | month_error << 1
+        | IsOutOfRange(day, 1, days_in_month) << 2
+        | IsOutOfRange(hour, 0, 23) << 3
+        | IsOutOfRange(minute, 0, 59) << 4
+        | IsOutOfRange(second, 0, 59) << 5);
+}
+
+// Пакетная проверка без исключений: для каждой записи маска полей, не прошедших проверку.
+// Поля записей лежат вперемешку, поэтому этот цикл остается скалярным, зато без исключений и ветвлений
+std::vector<uint8_t> CheckDateTimeValidity(std::span<const DateTime> records) {
+    std::vector<uint8_t> errors(records.size());
+    uint8_t* out = errors.data();
+    for (size_t i = 0; i < records.size(); ++i) {
+        const DateTime& dt = records[i];
+        out[i] = DateTimeErrorMask(dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second);
+    }
+    return errors;
+}
+
+// То же для столбцов. Каждое поле читается последовательно, что лучше всего подходит для векторизации
+std::vector<uint8_t> CheckDateTimeValidity(const DateTimeColumns& columns) {
+    const size_t size = columns.year.size();
+    if (columns.month.size() != size || columns.day.size() != size || columns.hour.size() != size
+        || columns.minute.size() != size || columns.second.size() != size) {
+        throw std::invalid_argument("DateTime columns have different sizes");
+    }
+    // Сырые указатели вместо span и vector: так GCC не теряет векторизацию из-за возможного наложения
+    const int* year = columns.year.data();
+    const int* month = columns.month.data();
+    const int* day = columns.day.data();
+    const int* hour = columns.hour.data();
+    const int* minute = columns.minute.data();
+    const int* second = columns.second.data();
+    std::vector<uint8_t> errors(size);
+    uint8_t* out = errors.data();
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = DateTimeErrorMask(year[i], month[i], day[i], hour[i], minute[i], second[i]);
+    }
+    return errors;
+}
+
+//------------------------------------------------------
+// Разбор строк фиксированной ширины YYYY-MM-DDTHH:MM:SS за один проход: цифры декодируются
+// по 8 байт в 64-битном слове (SWAR), и сразу же проверяются диапазоны полей
+
+constexpr size_t ISO_DATE_TIME_LENGTH = 19;
+
+// Маски и шаблоны одного 8-байтового слова: нулевой байт строки - младший байт слова
+struct IsoWordLayout {
+    uint64_t digits;     // 0xFF на месте цифр
+    uint64_t separators; // 0xFF на месте разделителей
+    uint64_t expected;   // Ожидаемые разделители на своих местах
+};
+
+// Слова берутся со смещений 0, 8 и 11: "YYYY-MM-", "DDT....." и "HH:MM:SS".
+// Второе и третье перекрываются, поэтому у второго проверяются только первые три байта
+constexpr IsoWordLayout ISO_DATE_WORD = {0xFF'FF'00'FF'FF'FF'FF, 0xFF'00'00'FF'00'00'00'00, 0x2D'00'00'2D'00'00'00'00};
+constexpr IsoWordLayout ISO_DAY_WORD = {0xFF'FF, 0xFF'00'00, 0x54'00'00};
+constexpr IsoWordLayout ISO_TIME_WORD = {0xFF'FF'00'FF'FF'00'FF'FF, 0x00'00'FF'00'00'FF'00'00, 0x00'00'3A'00'00'3A'00'00};
+
+constexpr uint64_t REPEATED_BYTE = 0x01'01'01'01'01'01'01'01;
+
+// 8 байт строки в порядке little-endian независимо от платформы. GCC и Clang сводят цикл к одной загрузке
+inline uint64_t LoadWord(const char* data) noexcept {
+    uint64_t word = 0;
+    for (int i = 0; i < 8; ++i) {
+        word |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return word;
+}
+
+// Все цифровые байты лежат в '0'..'9' и все разделители на месте.
+// Старший полубайт цифры должен быть 3 и остаться 3 после прибавления 6. Прибавка только к цифрам,
+// а цифра с полубайтом 0xF уже отсеяна первой проверкой, так что переносов между байтами нет
+inline bool MatchesLayout(uint64_t word, const IsoWordLayout& layout) noexcept {
+    const uint64_t high_nibbles = 0xF0 * REPEATED_BYTE & layout.digits;
+    const uint64_t expected_nibbles = 0x30 * REPEATED_BYTE & layout.digits;
+    return (word & high_nibbles) == expected_nibbles
+        && ((word + (0x06 * REPEATED_BYTE & layout.digits)) & high_nibbles) == expected_nibbles
+        && (word & layout.separators) == layout.expected;
+}
+
+// Значения цифр, разделители обнулены. Затем соседние байты сливаются в двузначные числа:
+// в байте k оказывается 10 * digit[k] + digit[k + 1], не больше 99, поэтому переносов тоже нет
+inline uint64_t DecodePairs(uint64_t word, const IsoWordLayout& layout) noexcept {
+    const uint64_t digits = word & 0x0F * REPEATED_BYTE & layout.digits;
+    return digits * 10 + (digits >> 8);
+}
+
+inline int PairAt(uint64_t pairs, int byte) noexcept {
+    return static_cast<int>((pairs >> (8 * byte)) & 0xFF);
+}
+
+// Разбор и проверка одной строки. Правила диапазонов те же, что в CheckDateTimeValidity.
+// result меняется только при успехе
+DateTimeStatus ParseDateTime(std::string_view text, DateTime& result) noexcept {
+    if (text.size() != ISO_DATE_TIME_LENGTH) {
+        return DateTimeError::InvalidFormat;
+    }
+    const uint64_t date_word = LoadWord(text.data());
+    const uint64_t day_word = LoadWord(text.data() + 8);
+    const uint64_t time_word = LoadWord(text.data() + 11);
+    // & вместо &&: все три проверки без ветвлений
+    if (!(MatchesLayout(date_word, ISO_DATE_WORD) & MatchesLayout(day_word, ISO_DAY_WORD)
+          & MatchesLayout(time_word, ISO_TIME_WORD))) {
+        return DateTimeError::InvalidFormat;
+    }
+
+    const uint64_t date_pairs = DecodePairs(date_word, ISO_DATE_WORD);
+    const uint64_t day_pairs = DecodePairs(day_word, ISO_DAY_WORD);
+    const uint64_t time_pairs = DecodePairs(time_word, ISO_TIME_WORD);
+    const int year = PairAt(date_pairs, 0) * 100 + PairAt(date_pairs, 2);
+    const int month = PairAt(date_pairs, 5);
+    const int day = PairAt(day_pairs, 0);
+    const int hour = PairAt(time_pairs, 0);
+    const int minute = PairAt(time_pairs, 3);
+    const int second = PairAt(time_pairs, 6);
+
+    const DateTimeStatus status = ValidateDateTime(year, month, day, hour, minute, second);
+    if (status) {
+        result.year = year;
+        result.month = month;
+        result.day = day;
+        result.hour = hour;
+        result.minute = minute;
+        result.second = second;
+    }
+    return status;
+}
+
+// Разбор буфера со строками через '\n' (допускается "\r\n") в заранее выделенные массивы:
+// i-я строка попадает в records[i] и statuses[i]. Для строк с ошибкой records[i] не меняется.
+// Разбирается не больше records.size() строк, возвращается их число.
+// Пустая строка после последнего перевода строки не считается
+size_t ParseDateTimeLines(std::string_view buffer, std::span<DateTime> records,
+                          std::span<DateTimeStatus> statuses) noexcept {
+    const size_t capacity = std::min(records.size(), statuses.size());
+    size_t count = 0;
+    while (!buffer.empty() && count < capacity) {
+        size_t line_end = ISO_DATE_TIME_LENGTH;
+        // Почти всегда строка ровно нужной длины, и поиск перевода строки не нужен
+        if (buffer.size() <= ISO_DATE_TIME_LENGTH || buffer[ISO_DATE_TIME_LENGTH] != '\n') {
+            line_end = std::min(buffer.find('\n'), buffer.size());
+        }
+        std::string_view line = buffer.substr(0, line_end);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        statuses[count] = ParseDateTime(line, records[count]);
+        ++count;
+        buffer.remove_prefix(std::min(line_end + 1, buffer.size()));
+    }
+    return count;
+}
+
+//------------------------------------------------------
+// Тесты: пакетная проверка и ParseDateTime сверяются с проверкой через исключения
+
+#include <cassert>
+#include <limits>
+#include <string>
+
+namespace tests {
+
+    template <typename Check>
+    bool Throws(Check check) {
+        try {
+            check();
+        }
+        catch (const std::domain_error&) {
+            return true;
+        }
+        return false;
+    }
+
+    // Эталон маски: каждое поле отдельно проверяется функцией с исключением.
+    // День с некорректным месяцем проверяется по январю, как в DateTimeErrorMask
+    uint8_t ReferenceErrorMask(const DateTime& dt) {
+        const bool month_error = Throws([&dt] { CheckMonthValidity(dt.month); });
+        const int month = month_error ? 1 : dt.month;
+        uint8_t mask = 0;
+        mask |= Throws([&dt] { CheckYearValidity(dt.year); }) ? YEAR_BIT : 0;
+        mask |= month_error ? MONTH_BIT : 0;
+        mask |= Throws([&dt, month] { CheckDayValidity(dt.year, month, dt.day); }) ? DAY_BIT : 0;
+        mask |= Throws([&dt] { CheckTimeUnitValidity(dt.hour, TimeUnit::Hour); }) ? HOUR_BIT : 0;
+        mask |= Throws([&dt] { CheckTimeUnitValidity(dt.minute, TimeUnit::Minute); }) ? MINUTE_BIT : 0;
+        mask |= Throws([&dt] { CheckTimeUnitValidity(dt.second, TimeUnit::Second); }) ? SECOND_BIT : 0;
+        return mask;
+    }
+
+    // Маски записей через обе перегрузки пакетной проверки. Они должны совпадать
+    std::vector<uint8_t> BatchErrorMasks(const std::vector<DateTime>& records) {
+        std::vector<int> year, month, day, hour, minute, second;
+        for (const DateTime& dt : records) {
+            year.push_back(dt.year);
+            month.push_back(dt.month);
+            day.push_back(dt.day);
+            hour.push_back(dt.hour);
+            minute.push_back(dt.minute);
+            second.push_back(dt.second);
+        }
+        const std::vector<uint8_t> masks = CheckDateTimeValidity(std::span<const DateTime>(records));
+        assert(CheckDateTimeValidity(DateTimeColumns{year, month, day, hour, minute, second}) == masks);
+        return masks;
+    }
+
+    void TestDateTimeErrorMask() {
+        constexpr int MIN_INT = std::numeric_limits<int>::min();
+        constexpr int MAX_INT = std::numeric_limits<int>::max();
+        const std::vector<std::pair<DateTime, uint8_t>> cases = {
+            {{2024, 2, 29, 0, 0, 0}, 0},
+            {{2023, 2, 29, 0, 0, 0}, DAY_BIT},
+            {{2000, 2, 29, 0, 0, 0}, 0},
+            {{1900, 2, 29, 0, 0, 0}, DAY_BIT},
+            {{2023, 2, 28, 23, 59, 59}, 0},
+            {{2024, 4, 31, 0, 0, 0}, DAY_BIT},
+            {{2024, 12, 31, 0, 0, 0}, 0},
+            {{1, 1, 1, 0, 0, 0}, 0},
+            {{9999, 12, 31, 23, 59, 59}, 0},
+            {{0, 1, 1, 0, 0, 0}, YEAR_BIT},
+            {{10000, 1, 1, 0, 0, 0}, YEAR_BIT},
+            {{2024, 0, 1, 0, 0, 0}, MONTH_BIT},
+            {{2024, 13, 1, 0, 0, 0}, MONTH_BIT},
+            {{2024, 13, 31, 0, 0, 0}, MONTH_BIT},
+            {{2024, 13, 32, 0, 0, 0}, MONTH_BIT | DAY_BIT},
+            {{2024, 1, 0, 0, 0, 0}, DAY_BIT},
+            {{2024, 1, 1, 24, 0, 0}, HOUR_BIT},
+            {{2024, 1, 1, -1, 0, 0}, HOUR_BIT},
+            {{2024, 1, 1, 0, 60, 0}, MINUTE_BIT},
+            {{2024, 1, 1, 0, -1, 0}, MINUTE_BIT},
+            {{2024, 1, 1, 0, 0, 60}, SECOND_BIT},
+            {{2024, 1, 1, 0, 0, -1}, SECOND_BIT},
+            {{0, 0, 0, 24, 60, 60}, YEAR_BIT | MONTH_BIT | DAY_BIT | HOUR_BIT | MINUTE_BIT | SECOND_BIT},
+            {{MIN_INT, MIN_INT, MIN_INT, MIN_INT, MIN_INT, MIN_INT},
+             YEAR_BIT | MONTH_BIT | DAY_BIT | HOUR_BIT | MINUTE_BIT | SECOND_BIT},
+            {{MAX_INT, MAX_INT, MAX_INT, MAX_INT, MAX_INT, MAX_INT},
+             YEAR_BIT | MONTH_BIT | DAY_BIT | HOUR_BIT | MINUTE_BIT | SECOND_BIT},
+        };
+        std::vector<DateTime> records;
+        for (const auto& [dt, expected] : cases) {
+            assert(ReferenceErrorMask(dt) == expected);
+            assert(DateTimeErrorMask(dt.year, dt.month, dt.day, dt.hour, dt.minute, dt.second) == expected);
+            records.push_back(dt);
+        }
+        const std::vector<uint8_t> masks = BatchErrorMasks(records);
+        for (size_t i = 0; i < cases.size(); ++i) {
+            assert(masks[i] == cases[i].second);
+        }
+
+        assert(BatchErrorMasks({}).empty());
+        // Столбцы разной длины
+        const std::vector<int> one = {1};
+        const std::vector<int> two = {1, 1};
+        bool thrown = false;
+        try {
+            (void)CheckDateTimeValidity(DateTimeColumns{one, one, two, one, one, one});
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // Поля берутся из граничных значений и их соседей, так что проверяется каждая граница диапазона
+    void FuzzDateTimeErrorMask() {
+        constexpr int MIN_INT = std::numeric_limits<int>::min();
+        constexpr int MAX_INT = std::numeric_limits<int>::max();
+        const std::vector<int> years = {MIN_INT, -400, -1, 0, 1, 2, 1900, 2000, 2023, 2024, 9999, 10000, MAX_INT};
+        const std::vector<int> months = {MIN_INT, -1, 0, 1, 2, 3, 4, 11, 12, 13, MAX_INT};
+        const std::vector<int> days = {MIN_INT, -1, 0, 1, 27, 28, 29, 30, 31, 32, MAX_INT};
+        const std::vector<int> hours = {MIN_INT, -1, 0, 1, 22, 23, 24, MAX_INT};
+        const std::vector<int> minutes = {MIN_INT, -1, 0, 1, 58, 59, 60, MAX_INT};
+        std::mt19937 generator(11);
+        const auto pick = [&generator](const std::vector<int>& values) {
+            return values[generator() % values.size()];
+        };
+
+        std::vector<DateTime> records(100'000);
+        for (DateTime& dt : records) {
+            dt = {pick(years), pick(months), pick(days), pick(hours), pick(minutes), pick(minutes)};
+        }
+        const std::vector<uint8_t> masks = BatchErrorMasks(records);
+        for (size_t i = 0; i < records.size(); ++i) {
+            const DateTime& dt = records[i];
+            assert(masks[i] == ReferenceErrorMask(dt));
+            // Маска пуста ровно тогда, когда проверка через исключения проходит
+            assert((masks[i] == 0) == !Throws([&dt] { CheckDateTimeValidity(dt); }));
+        }
+    }
+
+    // Эталон: посимвольный разбор формата, затем CheckDateTimeValidity.
+    // Возвращает текст ошибки или пустую строку
+    std::string ReferenceParseDateTime(std::string_view text, DateTime& result) {
+        constexpr std::string_view PATTERN = "dddd-dd-ddTdd:dd:dd";
+        if (text.size() != PATTERN.size()) {
+            return std::string(ErrorMessage(DateTimeError::InvalidFormat));
+        }
+        for (size_t i = 0; i < PATTERN.size(); ++i) {
+            const bool matches = PATTERN[i] == 'd' ? text[i] >= '0' && text[i] <= '9' : text[i] == PATTERN[i];
+            if (!matches) {
+                return std::string(ErrorMessage(DateTimeError::InvalidFormat));
+            }
+        }
+        const auto number = [text](size_t pos, size_t length) {
+            int value = 0;
+            for (size_t i = pos; i < pos + length; ++i) {
+                value = value * 10 + (text[i] - '0');
+            }
+            return value;
+        };
+        result.year = number(0, 4);
+        result.month = number(5, 2);
+        result.day = number(8, 2);
+        result.hour = number(11, 2);
+        result.minute = number(14, 2);
+        result.second = number(17, 2);
+        try {
+            CheckDateTimeValidity(result);
+        }
+        catch (const std::domain_error& error) {
+            return error.what();
+        }
+        return {};
+    }
+
+    // Строка формата YYYY-MM-DDTHH:MM:SS; каждое поле иногда выходит за допустимые пределы
+    std::string RandomIsoDateTime(std::mt19937& generator) {
+        const auto field = [&generator](int width, int typical_max) {
+            const int max = generator() % 8 == 0 ? (width == 4 ? 9999 : 99) : typical_max;
+            std::string digits = std::to_string(std::uniform_int_distribution<int>(0, max)(generator));
+            return std::string(width - digits.size(), '0') + digits;
+        };
+        return field(4, 2400) + '-' + field(2, 12) + '-' + field(2, 31) + 'T'
+            + field(2, 23) + ':' + field(2, 59) + ':' + field(2, 59);
+    }
+
+    // Случайная порча: замена байта, удаление или вставка символа
+    std::string Mutate(std::string text, std::mt19937& generator) {
+        const size_t pos = generator() % (text.size() + 1);
+        switch (generator() % 3) {
+        case 0:
+            if (pos < text.size()) {
+                text[pos] = static_cast<char>(generator() % 256);
+            }
+            break;
+        case 1:
+            if (pos < text.size()) {
+                text.erase(pos, 1);
+            }
+            break;
+        default:
+            text.insert(text.begin() + pos, "0-T:/9 \xFF"[generator() % 8]);
+            break;
+        }
+        return text;
+    }
+
+    void CheckAgainstReference(std::string_view text) {
+        DateTime expected{};
+        const std::string expected_error = ReferenceParseDateTime(text, expected);
+        DateTime parsed{};
+        const DateTimeStatus status = ParseDateTime(text, parsed);
+        assert(status.has_value() == expected_error.empty());
+        if (status) {
+            assert(parsed.year == expected.year && parsed.month == expected.month && parsed.day == expected.day);
+            assert(parsed.hour == expected.hour && parsed.minute == expected.minute && parsed.second == expected.second);
+        }
+        else {
+            assert(ErrorMessage(status.error()) == expected_error);
+        }
+    }
+
+    void TestParseDateTime() {
+        DateTime dt{};
+        assert(ParseDateTime("2024-02-29T23:59:59", dt));
+        assert(dt.year == 2024 && dt.month == 2 && dt.day == 29 && dt.hour == 23 && dt.minute == 59 && dt.second == 59);
+        assert(ParseDateTime("2023-02-29T00:00:00", dt).error() == DateTimeError::DayTooLargeForMonth);
+        assert(ParseDateTime("0000-01-01T00:00:00", dt).error() == DateTimeError::YearTooSmall);
+        assert(ParseDateTime("2024-00-01T00:00:00", dt).error() == DateTimeError::MonthTooSmall);
+        assert(ParseDateTime("2024-01-01T24:00:00", dt).error() == DateTimeError::HourTooLarge);
+        assert(ParseDateTime("2024-01-01 00:00:00", dt).error() == DateTimeError::InvalidFormat);
+        assert(ParseDateTime("2024-01-01T00:00:0", dt).error() == DateTimeError::InvalidFormat);
+        assert(ParseDateTime("2024-01-01T00:00:0:", dt).error() == DateTimeError::InvalidFormat);
+        assert(ParseDateTime("2024-01-01T00:0\xFF:00", dt).error() == DateTimeError::InvalidFormat);
+        // Неудачный разбор не трогает результат
+        assert(dt.year == 2024 && dt.month == 2 && dt.day == 29);
+    }
+
+    void FuzzParseDateTime() {
+        std::mt19937 generator(2024);
+        for (int i = 0; i < 200'000; ++i) {
+            std::string text = RandomIsoDateTime(generator);
+            CheckAgainstReference(text);
+            for (int mutations = generator() % 3; mutations > 0; --mutations) {
+                text = Mutate(std::move(text), generator);
+            }
+            CheckAgainstReference(text);
+        }
+    }
+
+    void FuzzParseDateTimeLines() {
+        std::mt19937 generator(7);
+        for (int i = 0; i < 1'000; ++i) {
+            std::vector<std::string> lines(generator() % 50);
+            std::string buffer;
+            for (std::string& line : lines) {
+                line = RandomIsoDateTime(generator);
+                if (generator() % 4 == 0) {
+                    line = Mutate(line, generator);
+                }
+                // Перевод строки внутри строки ломает разбиение, такие случаи проверяются отдельно
+                line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+                buffer += line;
+                buffer += generator() % 5 == 0 ? "\r\n" : "\n";
+            }
+            if (!lines.empty() && generator() % 2 == 0) {
+                buffer.pop_back(); // Без перевода строки в конце
+                if (!buffer.empty() && buffer.back() == '\r') {
+                    buffer.pop_back();
+                }
+            }
+            if (!lines.empty() && !lines.back().empty() && lines.back().back() == '\r') {
+                continue; // Такой '\r' неотличим от "\r\n"
+            }
+
+            std::vector<DateTime> records(lines.size() + 1);
+            std::vector<DateTimeStatus> statuses(lines.size() + 1);
+            const size_t count = ParseDateTimeLines(buffer, records, statuses);
+            const size_t expected_count = buffer.empty() ? 0 : lines.size();
+            assert(count == expected_count);
+            for (size_t j = 0; j < count; ++j) {
+                DateTime dt{};
+                const DateTimeStatus status = ParseDateTime(lines[j], dt);
+                assert(statuses[j].has_value() == status.has_value());
+                if (status) {
+                    assert(records[j].year == dt.year && records[j].second == dt.second);
+                }
+                else {
+                    assert(statuses[j].error() == status.error());
+                }
+            }
+        }
+
+        // Разбирается не больше строк, чем помещается в массивы
+        std::vector<DateTime> records(2);
+        std::vector<DateTimeStatus> statuses(2);
+        assert(ParseDateTimeLines("2024-01-01T00:00:00\n2024-01-02T00:00:00\n2024-01-03T00:00:00", records, statuses) == 2);
+        assert(records[1].day == 2);
+    }
+
+    void TestAll() {
+        TestDateTimeErrorMask();
+        FuzzDateTimeErrorMask();
+        TestParseDateTime();
+        FuzzParseDateTime();
+        FuzzParseDateTimeLines();
+    }
+
+}//!namespace tests
+
+//------------------------------------------------------
+// Замер стоимости исключений: одна и та же выборка проверяется версией с throw и версией с кодом ошибки
+// при разной доле некорректных записей. Пока ошибок нет, обе версии почти равны; каждая ошибка
+// в версии с throw стоит раскрутки стека, и ее время растет вместе с долей ошибок
+
+namespace bench {
+
+    // Записи, из которых примерно invalid_rate некорректны в одном случайно выбранном поле
+    std::vector<DateTime> GenerateDateTimes(size_t count, double invalid_rate, std::mt19937& generator) {
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        std::uniform_int_distribution<int> field(0, 5);
+        std::vector<DateTime> records(count);
+        for (DateTime& dt : records) {
+            dt.year = std::uniform_int_distribution<int>(1, 9999)(generator);
+            dt.month = std::uniform_int_distribution<int>(1, 12)(generator);
+            dt.day = std::uniform_int_distribution<int>(1, DaysInMonth(dt.year, dt.month))(generator);
+            dt.hour = std::uniform_int_distribution<int>(0, 23)(generator);
+            dt.minute = std::uniform_int_distribution<int>(0, 59)(generator);
+            dt.second = std::uniform_int_distribution<int>(0, 59)(generator);
+            if (chance(generator) >= invalid_rate) {
+                continue;
+            }
+            switch (field(generator)) {
+            case 0:
+                dt.year = 10000;
+                break;
+            case 1:
+                dt.month = 13;
+                break;
+            case 2:
+                dt.day = 32;
+                break;
+            case 3:
+                dt.hour = 24;
+                break;
+            case 4:
+                dt.minute = -1;
+                break;
+            default:
+                dt.second = 60;
+                break;
+            }
+        }
+        return records;
+    }
+
+    void ThrowingVsNonThrowing(std::ostream& out, size_t count = 1'000'000) {
+        using Clock = std::chrono::steady_clock;
+        const auto to_ms = [](Clock::duration elapsed) {
+            return std::chrono::duration<double, std::milli>(elapsed).count();
+        };
+        std::mt19937 generator(42);
+
+        out << "invalid_rate\tthrow_ms\texpected_ms\n";
+        for (const double invalid_rate : {0.0, 0.001, 0.01, 0.1, 0.5, 1.0}) {
+            const std::vector<DateTime> records = GenerateDateTimes(count, invalid_rate, generator);
+
+            size_t thrown = 0;
+            const auto throw_start = Clock::now();
+            for (const DateTime& dt : records) {
+                try {
+                    CheckDateTimeValidity(dt);
+                }
+                catch (const std::domain_error&) {
+                    ++thrown;
+                }
+            }
+            const auto throw_elapsed = Clock::now() - throw_start;
+
+            size_t failed = 0;
+            const auto status_start = Clock::now();
+            for (const DateTime& dt : records) {
+                failed += !ValidateDateTime(dt);
+            }
+            const auto status_elapsed = Clock::now() - status_start;
+
+            if (thrown != failed) {
+                throw std::logic_error("Throwing and non-throwing validation disagree");
+            }
+            out << invalid_rate << '\t' << to_ms(throw_elapsed) << '\t' << to_ms(status_elapsed) << '\n';
+        }
+    }
+
+}//!namespace bench
@@ -0,0 +1,28 @@
+// Запуск тестов и замеров CheckDateTimeValidity.cpp. Сам CheckDateTimeValidity.cpp - фрагмент
+// программы: структура DateTime приходит из остального проекта и определена здесь с теми же полями,
+// а все остальное - код из CheckDateTimeValidity.cpp как есть.
+// Сборка: g++ -std=c++20 -O2 CheckDateTimeValidityMain.cpp
+// Без ключей выполняются тесты, с ключом --bench после них еще и замеры
+
+#include <iostream>
+#include <string_view>
+
+struct DateTime {
+    int year;
+    int month;
+    int day;
+    int hour;
+    int minute;
+    int second;
+};
+
+#include "CheckDateTimeValidity.cpp"
+
+int main(int argc, char* argv[]) {
+    using namespace std::literals;
+    tests::TestAll();
+    if (argc > 1 && argv[1] == "--bench"sv) {
+        bench::ThrowingVsNonThrowing(std::cout);
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "HeapStats.h"
+
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h> //malloc_usable_size
+
+// Замена глобальных operator new и operator delete (обычных, nothrow и для массивов), которая
+// учитывает каждое выделение и освобождение в счетчиках heap_stats. Размер блока - тот, что
+// реально выдал malloc, а не запрошенный. Только для программ с замерами: каждое выделение
+// становится дороже на три атомарные операции и вызов malloc_usable_size
+
+void* operator new(std::size_t size) {
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    heap_stats::allocations.fetch_add(1, std::memory_order_relaxed);
+    heap_stats::bytes_in_use.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+    heap_stats::blocks_in_use.fetch_add(1, std::memory_order_relaxed);
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr != nullptr) {
+        heap_stats::bytes_in_use.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+        heap_stats::blocks_in_use.fetch_sub(1, std::memory_order_relaxed);
+        std::free(ptr);
+    }
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    operator delete(ptr);
+}
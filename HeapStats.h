@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Счетчики кучи для бенчмарков. Сами счетчики только объявлены здесь: их ведет замена
+// глобальных operator new и operator delete из HeapStats.cpp, которая собирается только
+// в программы с замерами. Без HeapStats.cpp распределитель не меняется и счетчики остаются нулями
+namespace heap_stats {
+
+    inline std::atomic<size_t> allocations = 0;
+    inline std::atomic<size_t> bytes_in_use = 0;
+    inline std::atomic<size_t> blocks_in_use = 0;
+
+    // Число вызовов operator new с начала работы программы
+    inline size_t Allocations() noexcept {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    // Байты в блоках, выделенных через operator new и еще не освобожденных
+    inline size_t BytesInUse() noexcept {
+        return bytes_in_use.load(std::memory_order_relaxed);
+    }
+
+    // Число блоков, выделенных через operator new и еще не освобожденных
+    inline size_t BlocksInUse() noexcept {
+        return blocks_in_use.load(std::memory_order_relaxed);
+    }
+
+}//!namespace heap_stats
@@ -13,43 +13,370 @@ struct QueryConfig {
     string_view name_filter;        // Фильтр по имени
 };
 
-// Загрузка списка людей из базы данных на основе конфигурации
-vector<Person> LoadPersons(const DBConfig& db_config, const QueryConfig& query_config) {
-    // Создание подключения к базе данных
-    DBConnector connector(db_config.allow_exceptions, db_config.log_level);
-    DBHandler db;
+//------------------------------------------------------------------------------------------
+// Подготовленные запросы. Обработчик с методом Prepare(text) возвращает подготовленный запрос,
+// который выполняется через LoadRows<Types...>(statement, parameters...). База разбирает запрос
+// и строит план один раз, а не при каждом вызове с новыми значениями в тексте.
+// У DBHandler такого метода нет, и для него запрос по-прежнему уходит текстом (BuildPersonQuery)
+
+// Концепт проверяет обе части: Prepare и выполнение подготовленного запроса с параметрами
+// выборки людей (возраст от, возраст до, шаблон имени), чтобы обработчик без такого LoadRows
+// отсекался здесь, а не ошибкой глубоко в шаблонах LoadPersons
+template <typename Handler>
+concept PreparedStatementHandler = requires(Handler& db, string_view text) {
+    db.Prepare(text);
+} && requires(Handler& db, decltype(declval<Handler&>().Prepare(string_view{}))& statement, int age, string_view name_pattern) {
+    db.template LoadRows<string, int>(statement, age, age, name_pattern);
+};
+
+// Кэш подготовленных запросов одного подключения по тексту запроса.
+// Для обработчиков без Prepare пуст и ничего не хранит
+template <typename Handler>
+class StatementCache {
+};
+
+template <PreparedStatementHandler Handler>
+class StatementCache<Handler> {
+public:
+    using Statement = decltype(declval<Handler&>().Prepare(string_view{}));
+
+    // Подготавливает запрос при первом обращении
+    Statement& Get(Handler& db, string_view text);
+
+private:
+    map<string, Statement, less<>> statements_;
+};
+
+template <PreparedStatementHandler Handler>
+typename StatementCache<Handler>::Statement& StatementCache<Handler>::Get(Handler& db, string_view text) {
+    auto it = statements_.find(text);
+    if (it == statements_.end()) {
+        it = statements_.emplace(string(text), db.Prepare(text)).first;
+    }
+    return it->second;
+}
+
+//------------------------------------------------------------------------------------------
+// Пул подключений: установка соединения дороже самого запроса, поэтому подключения переиспользуются.
+// Подключения к одной базе с одинаковыми настройками взаимозаменяемы, ключ пула - DBConfig без таймаута
+
+// Загрузка остановлена через stop_token раньше, чем завершилась
+class LoadStopped : public runtime_error {
+public:
+    LoadStopped()
+        : runtime_error("Load stopped"s) {
+    }
+};
+
+// Выбрасывает LoadStopped, если запрошена остановка
+void ThrowIfStopped(const stop_token& stop) {
+    if (stop.stop_requested()) {
+        throw LoadStopped();
+    }
+}
+
+struct ConnectionKey {
+    string name;
+    DBLogLevel log_level;
+    bool allow_exceptions;
+
+    auto operator<=>(const ConnectionKey&) const = default;
+};
+
+// Connector - DBConnector или подмена для тестов с тем же интерфейсом
+template <typename Connector>
+class BasicConnectionPool {
+public:
+    using Handler = decltype(declval<Connector&>().Connect(string_view{}, 0));
+    using Clock = chrono::steady_clock;
+
+    class Lease;
+
+    // max_connections - предел подключений на один ключ, выданных и свободных вместе.
+    // Свободное подключение закрывается, если им не пользовались дольше idle_timeout
+    BasicConnectionPool(size_t max_connections, Clock::duration idle_timeout);
+
+    // Выдает исправное подключение: свободное из пула или новое. Если предел исчерпан,
+    // ждет возврата другого подключения. Подключение возвращается в пул при разрушении Lease.
+    // Если исключения запрещены, а подключиться не удалось, выдается подключение с IsOK() == false.
+    // Если через stop запрошена остановка, ожидание прерывается и выбрасывается LoadStopped.
+    // Уже начатое подключение к базе не прерывается: его ограничивает только connection_timeout
+    Lease Acquire(const DBConfig& db_config, stop_token stop = {});
+
+    // Закрывает свободные подключения, простаивающие дольше idle_timeout
+    void EvictIdle();
+
+private:
+    // Подключение хранится вместе со своим DBConnector: обработчик может от него зависеть
+    struct Connection {
+        Connection(const DBConfig& db_config);
+
+        Connector connector;
+        Handler handler;
+        StatementCache<Handler> statements; // Объявлен после handler, чтобы закрыться раньше него
+        Clock::time_point last_used;
+    };
+
+    // Свободные подключения упорядочены по времени возврата: в начале самые старые.
+    // У каждого ключа свое ожидание: возврат подключения к одной базе будит только ждущих ее
+    struct KeyState {
+        deque<unique_ptr<Connection>> idle;
+        size_t total = 0; // Выданные и свободные
+        condition_variable_any released; // _any - чтобы ожидание прерывалось через stop_token
+    };
+
+    void Release(KeyState& state, unique_ptr<Connection> connection);
+    // Освобождает место подключения, которое закрыто или так и не открылось
+    void Forget(KeyState& state);
+    // Переносит устаревшие подключения в expired, чтобы закрыть их уже без блокировки
+    void TakeExpired(KeyState& state, Clock::time_point now, vector<unique_ptr<Connection>>& expired);
+
+    const size_t max_connections_;
+    const Clock::duration idle_timeout_;
+    mutex mutex_;
+    map<ConnectionKey, KeyState> states_; // Узлы map не перемещаются, Lease хранит ссылку на KeyState
+};
+
+template <typename Connector>
+class BasicConnectionPool<Connector>::Lease {
+public:
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&&) = delete;
+    ~Lease();
+
+    Handler& operator*() const;
+    Handler* operator->() const;
+    // Подготовленный запрос из кэша этого подключения
+    decltype(auto) Prepare(string_view text);
+
+private:
+    friend class BasicConnectionPool;
+    Lease(BasicConnectionPool* pool, KeyState* state, unique_ptr<Connection> connection);
 
+    BasicConnectionPool* pool_;
+    KeyState* state_;
+    unique_ptr<Connection> connection_;
+};
+
+using ConnectionPool = BasicConnectionPool<DBConnector>;
+
+template <typename Connector>
+BasicConnectionPool<Connector>::Connection::Connection(const DBConfig& db_config)
+    : connector(db_config.allow_exceptions, db_config.log_level) {
     // Установка соединения в зависимости от типа базы данных
     if (db_config.name.starts_with("tmp."s)) {
-        db = connector.ConnectTmp(db_config.name, db_config.connection_timeout);
+        handler = connector.ConnectTmp(db_config.name, db_config.connection_timeout);
     }
     else {
-        db = connector.Connect(db_config.name, db_config.connection_timeout);
+        handler = connector.Connect(db_config.name, db_config.connection_timeout);
+    }
+}
+
+template <typename Connector>
+BasicConnectionPool<Connector>::BasicConnectionPool(size_t max_connections, Clock::duration idle_timeout)
+    : max_connections_(max_connections)
+    , idle_timeout_(idle_timeout) {
+}
+
+template <typename Connector>
+typename BasicConnectionPool<Connector>::Lease BasicConnectionPool<Connector>::Acquire(const DBConfig& db_config, stop_token stop) {
+    const ConnectionKey key{string(db_config.name), db_config.log_level, db_config.allow_exceptions};
+    while (true) {
+        vector<unique_ptr<Connection>> closed; // Закрываются после снятия блокировки
+        unique_ptr<Connection> connection;
+        KeyState* state = nullptr;
+        {
+            unique_lock lock(mutex_);
+            state = &states_[key];
+            while (true) {
+                ThrowIfStopped(stop);
+                TakeExpired(*state, Clock::now(), closed);
+                if (!state->idle.empty()) {
+                    // Последнее возвращенное подключение, оно реже других успевает оборваться
+                    connection = move(state->idle.back());
+                    state->idle.pop_back();
+                    break;
+                }
+                if (state->total < max_connections_) {
+                    // Место под новое подключение занято заранее, а само подключение идет без блокировки
+                    ++state->total;
+                    break;
+                }
+                state->released.wait(lock, stop, [this, state] {
+                    return !state->idle.empty() || state->total < max_connections_;
+                });
+            }
+        }
+
+        if (!connection) {
+            try {
+                return Lease(this, state, make_unique<Connection>(db_config));
+            }
+            catch (...) {
+                Forget(*state);
+                throw;
+            }
+        }
+        // IsOK может обращаться к базе, поэтому проверка идет без блокировки пула.
+        // Место в total остается за подключением, пока оно не признано неисправным
+        if (connection->handler.IsOK()) {
+            return Lease(this, state, move(connection));
+        }
+        Forget(*state);
+    }
+}
+
+template <typename Connector>
+void BasicConnectionPool<Connector>::EvictIdle() {
+    vector<unique_ptr<Connection>> expired;
+    const Clock::time_point now = Clock::now();
+    lock_guard lock(mutex_);
+    for (auto& [key, state] : states_) {
+        TakeExpired(state, now, expired);
+        // Освободились места под новые подключения
+        state.released.notify_all();
     }
+}
+
+template <typename Connector>
+void BasicConnectionPool<Connector>::Release(KeyState& state, unique_ptr<Connection> connection) {
+    // Как и в Acquire, проверка идет без блокировки пула
+    if (!connection->handler.IsOK()) {
+        Forget(state);
+        // Неисправное подключение закрывается здесь, уже без блокировки
+        return;
+    }
+    {
+        lock_guard lock(mutex_);
+        connection->last_used = Clock::now();
+        state.idle.push_back(move(connection));
+    }
+    state.released.notify_one();
+}
+
+template <typename Connector>
+void BasicConnectionPool<Connector>::Forget(KeyState& state) {
+    {
+        lock_guard lock(mutex_);
+        --state.total;
+    }
+    state.released.notify_one();
+}
 
-    // Если запрещено выкидывать исключения и база данных не готова к работе
-    // Возвращаем пустой результат и завершаем работу функции
-    if (!db_config.allow_exceptions && !db.IsOK()) {
-        return {};
+template <typename Connector>
+void BasicConnectionPool<Connector>::TakeExpired(KeyState& state, Clock::time_point now,
+                                                 vector<unique_ptr<Connection>>& expired) {
+    while (!state.idle.empty() && now - state.idle.front()->last_used > idle_timeout_) {
+        expired.push_back(move(state.idle.front()));
+        state.idle.pop_front();
+        --state.total;
     }
+}
+
+template <typename Connector>
+BasicConnectionPool<Connector>::Lease::Lease(BasicConnectionPool* pool, KeyState* state, unique_ptr<Connection> connection)
+    : pool_(pool)
+    , state_(state)
+    , connection_(move(connection)) {
+}
+
+template <typename Connector>
+BasicConnectionPool<Connector>::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_)
+    , state_(other.state_)
+    , connection_(move(other.connection_)) {
+}
+
+template <typename Connector>
+BasicConnectionPool<Connector>::Lease::~Lease() {
+    if (connection_) {
+        pool_->Release(*state_, move(connection_));
+    }
+}
 
-    // Построение запроса на основе конфигурации
-    DBQuery query = BuildPersonQuery(query_config);
+template <typename Connector>
+typename BasicConnectionPool<Connector>::Handler& BasicConnectionPool<Connector>::Lease::operator*() const {
+    return connection_->handler;
+}
+
+template <typename Connector>
+typename BasicConnectionPool<Connector>::Handler* BasicConnectionPool<Connector>::Lease::operator->() const {
+    return &connection_->handler;
+}
+
+template <typename Connector>
+decltype(auto) BasicConnectionPool<Connector>::Lease::Prepare(string_view text) {
+    return connection_->statements.Get(connection_->handler, text);
+}
+
+// Пул по умолчанию для LoadPersons без явного пула
+ConnectionPool& DefaultConnectionPool() {
+    static ConnectionPool pool(8, chrono::minutes(1));
+    return pool;
+}
+
+//------------------------------------------------------------------------------------------
 
-    // Загрузка людей из базы данных
-    vector<Person> persons = LoadPersonsFromDB(db, query);
+// Размер пачки, которой LoadPersons без потребителя переносит людей в итоговый вектор
+constexpr size_t PERSONS_CHUNK_SIZE = 1024;
 
+// Загрузка списка людей из базы данных на основе конфигурации.
+// Подключение берется из пула и возвращается в него после загрузки
+template <typename Connector>
+vector<Person> LoadPersons(BasicConnectionPool<Connector>& pool, const DBConfig& db_config, const QueryConfig& query_config) {
+    vector<Person> persons;
+    LoadPersons(pool, db_config, query_config, PERSONS_CHUNK_SIZE, [&persons](span<Person> chunk) {
+        move(chunk.begin(), chunk.end(), back_inserter(persons));
+    });
     return persons;
 }
 
-// Построение запроса на выборку пюдей на основе конфигурации
-DBQuery BuildPersonQuery(const QueryConfig& query_config) {
-    ostringstream query_str;
-    query_str << "from Persons "s
-        << "select Name, Age "s
-        << "where Age between "s << query_config.min_age << " and "s << query_config.max_age << " "s
-        << "and Name like '%"s << db.Quote(query_config.name_filter) << "%'"s;
-    return DBQuery(query_str.str());
+vector<Person> LoadPersons(const DBConfig& db_config, const QueryConfig& query_config) {
+    return LoadPersons(DefaultConnectionPool(), db_config, query_config);
+}
+
+// Запрос на выборку людей с параметрами: возраст от, возраст до, шаблон имени для like.
+// Текст не зависит от значений, поэтому подготавливается один раз на подключение
+constexpr string_view PERSONS_QUERY = "from Persons select Name, Age where Age between ? and ? and Name like ?"sv;
+
+// Шаблон like для поиска подстроки. Значение передается параметром, поэтому Quote не нужен
+string MakeLikePattern(string_view name_filter) {
+    string pattern;
+    pattern.reserve(name_filter.size() + 2);
+    pattern += '%';
+    pattern += name_filter;
+    pattern += '%';
+    return pattern;
+}
+
+void AppendNumber(string& str, int value) {
+    array<char, 16> buffer;
+    const auto [end, ec] = to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    str.append(buffer.data(), end);
+}
+
+// Текст запроса на выборку людей со значениями в тексте, тот же, что прежде собирался через ostringstream.
+// Собирается в одной строке. Фильтр по имени экранирует сам обработчик через Quote
+template <typename Handler>
+string BuildPersonQueryText(Handler& db, const QueryConfig& query_config) {
+    const auto quoted_name = db.Quote(query_config.name_filter);
+    string query_str;
+    query_str.reserve(96 + quoted_name.size());
+    query_str += "from Persons select Name, Age where Age between "sv;
+    AppendNumber(query_str, query_config.min_age);
+    query_str += " and "sv;
+    AppendNumber(query_str, query_config.max_age);
+    query_str += " and Name like '%"sv;
+    query_str += quoted_name;
+    query_str += "%'"sv;
+    return query_str;
+}
+
+// Построение запроса на выборку пюдей на основе конфигурации, со значениями в тексте.
+// Нужно для обработчиков без подготовленных запросов
+template <typename Handler>
+DBQuery BuildPersonQuery(Handler& db, const QueryConfig& query_config) {
+    return DBQuery(BuildPersonQueryText(db, query_config));
 }
 
 // Загрузка списка людей из базы данных на основе запроса
@@ -63,3 +390,1108 @@ vector<Person> LoadPersonsFromDB(DBHandler& db, const DBQuery& query) {
 
     return persons;
 }
+
+// Передает строки rows в consume пачками по chunk_size (последняя может быть меньше)
+// по мере чтения, не дожидаясь конца выборки. В памяти не больше одной пачки, ее буфер
+// переиспользуется. consume принимает span<Person> и может забирать людей через move.
+// Возвращает общее число людей
+template <typename Rows, typename Consumer>
+size_t CollectPersonChunks(Rows&& rows, size_t chunk_size, Consumer&& consume) {
+    if (chunk_size == 0) {
+        throw invalid_argument("Chunk size must be positive"s);
+    }
+    vector<Person> chunk;
+    chunk.reserve(chunk_size);
+    size_t total = 0;
+    const auto flush = [&] {
+        total += chunk.size();
+        consume(span<Person>(chunk));
+        chunk.clear();
+    };
+
+    for (auto [name, age] : rows) {
+        chunk.push_back({ move(name), age });
+        if (chunk.size() == chunk_size) {
+            flush();
+        }
+    }
+    if (!chunk.empty()) {
+        flush();
+    }
+    return total;
+}
+
+// Потоковая загрузка по готовому запросу, см. CollectPersonChunks
+template <typename Handler, typename Consumer>
+size_t LoadPersonsFromDB(Handler& db, const DBQuery& query, size_t chunk_size, Consumer&& consume) {
+    return CollectPersonChunks(db.template LoadRows<string, int>(query), chunk_size, forward<Consumer>(consume));
+}
+
+// Выполняет выборку людей на подключении из пула и отдает строки результата в read_rows,
+// возвращая то, что вернул read_rows. Если обработчик умеет подготавливать запросы, выполняется
+// закэшированный на подключении PERSONS_QUERY, иначе запрос со значениями в тексте.
+// Если база не готова, а исключения запрещены, read_rows не вызывается и возвращается Result{}.
+// Остановка через stop проверяется при ожидании подключения и перед запросом (LoadStopped),
+// а уже отправленный запрос драйвер прервать не дает
+template <typename Result, typename Connector, typename Reader>
+Result ReadPersonRows(BasicConnectionPool<Connector>& pool, const DBConfig& db_config, const QueryConfig& query_config,
+                      Reader&& read_rows, stop_token stop = {}) {
+    using Handler = typename BasicConnectionPool<Connector>::Handler;
+    typename BasicConnectionPool<Connector>::Lease db = pool.Acquire(db_config, stop);
+    if (!db_config.allow_exceptions && !db->IsOK()) {
+        return Result{};
+    }
+    ThrowIfStopped(stop);
+    if constexpr (PreparedStatementHandler<Handler>) {
+        auto& statement = db.Prepare(PERSONS_QUERY);
+        const string name_pattern = MakeLikePattern(query_config.name_filter);
+        return read_rows(
+            db->template LoadRows<string, int>(statement, query_config.min_age, query_config.max_age, string_view(name_pattern)));
+    }
+    else {
+        return read_rows(db->template LoadRows<string, int>(BuildPersonQuery(*db, query_config)));
+    }
+}
+
+// Потоковый вариант LoadPersons, см. ReadPersonRows и CollectPersonChunks.
+// Остановка через stop проверяется еще и перед каждой пачкой
+template <typename Connector, typename Consumer>
+size_t LoadPersons(BasicConnectionPool<Connector>& pool, const DBConfig& db_config, const QueryConfig& query_config,
+                   size_t chunk_size, Consumer&& consume, stop_token stop = {}) {
+    return ReadPersonRows<size_t>(pool, db_config, query_config, [&](auto&& rows) {
+        return CollectPersonChunks(rows, chunk_size, [&](span<Person> chunk) {
+            ThrowIfStopped(stop);
+            consume(chunk);
+        });
+    }, stop);
+}
+
+//------------------------------------------------------------------------------------------
+// Колоночный результат: возрасты подряд в одном массиве, имена подряд в одном буфере.
+// Вместо отдельной строки на каждого человека результат держит три непрерывных блока памяти,
+// и перебор по возрасту читает только массив возрастов
+
+class PersonColumns {
+public:
+    void Reserve(size_t persons, size_t name_bytes);
+    void Append(string_view name, int age);
+    void Append(span<const Person> persons);
+
+    size_t Size() const;
+    string_view Name(size_t index) const;
+    int Age(size_t index) const;
+    span<const int> Ages() const;
+
+    vector<Person> ToPersons() const;
+    // Для кода, который ждет vector<Person>
+    operator vector<Person>() const;
+
+private:
+    vector<int> ages_;
+    string names_;                      // Все имена подряд без разделителей
+    vector<size_t> name_offsets_ = {0}; // Имя i занимает [name_offsets_[i], name_offsets_[i + 1])
+};
+
+void PersonColumns::Reserve(size_t persons, size_t name_bytes) {
+    ages_.reserve(persons);
+    name_offsets_.reserve(persons + 1);
+    names_.reserve(name_bytes);
+}
+
+void PersonColumns::Append(string_view name, int age) {
+    ages_.push_back(age);
+    names_ += name;
+    name_offsets_.push_back(names_.size());
+}
+
+void PersonColumns::Append(span<const Person> persons) {
+    size_t name_bytes = 0;
+    for (const Person& person : persons) {
+        name_bytes += person.name.size();
+    }
+    // Рост по пачкам, а не по одному имени
+    if (names_.capacity() < names_.size() + name_bytes) {
+        names_.reserve(max(names_.size() + name_bytes, names_.capacity() * 2));
+    }
+    for (const Person& person : persons) {
+        Append(person.name, person.age);
+    }
+}
+
+size_t PersonColumns::Size() const {
+    return ages_.size();
+}
+
+string_view PersonColumns::Name(size_t index) const {
+    return string_view(names_).substr(name_offsets_[index], name_offsets_[index + 1] - name_offsets_[index]);
+}
+
+int PersonColumns::Age(size_t index) const {
+    return ages_[index];
+}
+
+span<const int> PersonColumns::Ages() const {
+    return ages_;
+}
+
+vector<Person> PersonColumns::ToPersons() const {
+    vector<Person> persons;
+    persons.reserve(Size());
+    for (size_t i = 0; i < Size(); ++i) {
+        persons.push_back({ string(Name(i)), ages_[i] });
+    }
+    return persons;
+}
+
+PersonColumns::operator vector<Person>() const {
+    return ToPersons();
+}
+
+// Переносит строки rows в колоночный результат по одной, без промежуточных Person.
+// Драйвер по-прежнему отдает имя каждой строки отдельной string: она освобождается сразу после
+// копирования в общий буфер, так что результат держит три блока, но при загрузке
+// выделений не меньше, чем строк
+template <typename Rows>
+PersonColumns CollectPersonColumns(Rows&& rows) {
+    PersonColumns columns;
+    for (auto&& [name, age] : rows) {
+        columns.Append(name, age);
+    }
+    return columns;
+}
+
+// Загрузка в колоночный результат по готовому запросу
+template <typename Handler>
+PersonColumns LoadPersonColumnsFromDB(Handler& db, const DBQuery& query) {
+    return CollectPersonColumns(db.template LoadRows<string, int>(query));
+}
+
+// Загрузка людей сразу в колоночный результат, см. ReadPersonRows и CollectPersonColumns
+template <typename Connector>
+PersonColumns LoadPersonColumns(BasicConnectionPool<Connector>& pool, const DBConfig& db_config,
+                                const QueryConfig& query_config) {
+    return ReadPersonRows<PersonColumns>(pool, db_config, query_config, [](auto&& rows) {
+        return CollectPersonColumns(rows);
+    });
+}
+
+//------------------------------------------------------------------------------------------
+// Загрузка с нескольких баз сразу: таблица Persons разнесена по базам, и запросы к ним
+// идут параллельно, а не друг за другом
+
+// Порядок людей в объединенном результате. При равенстве ключа сохраняется порядок баз
+enum class PersonsOrder {
+    Shards, // Как вернули базы, базы в порядке перечисления
+    Name,
+    Age
+};
+
+struct ShardedPersons {
+    vector<Person> persons;
+    // Базы без исключений, которые не ответили к сроку или завершились ошибкой
+    vector<size_t> failed_shards;
+};
+
+// Загрузка одной базы. Загрузка, которой запрошена остановка через stop_token, должна
+// завершиться как можно скорее, ее результат все равно будет отброшен
+using ShardLoader = function<vector<Person>(const DBConfig&, const QueryConfig&, stop_token)>;
+
+// Число потоков загрузки по умолчанию, сколько бы ни было баз
+constexpr size_t MAX_SHARD_THREADS = 8;
+
+// Базы загружаются в max_threads потоках: каждый поток берет следующую еще не начатую базу.
+// Для баз с allow_exceptions ошибка или опоздание к сроку выбрасывается как исключение
+// (первая по порядку баз), остальные базы при ошибке попадают в failed_shards.
+// Результат или исключение возвращаются не позже срока. К сроку всем загрузкам запрашивается
+// остановка, еще не начатые базы не загружаются, а опоздавших никто не ждет: вызов драйвера
+// (подключение, запрос) может не вернуться еще долго, поэтому потоки отсоединены и владеют
+// общим состоянием сами. Загрузчик и все, на что он ссылается, должны жить, пока потоки
+// не завершатся, а стоит остановленный поток не больше одного вызова драйвера.
+// Загрузчик по умолчанию - потоковый LoadPersons через пул по умолчанию: остановка прерывает
+// ожидание подключения в пуле и проверяется перед запросом и перед каждой пачкой строк
+ShardedPersons LoadPersonsSharded(const vector<DBConfig>& shards, const QueryConfig& query_config,
+                                  chrono::steady_clock::duration timeout, PersonsOrder order = PersonsOrder::Shards,
+                                  ShardLoader loader = nullptr, size_t max_threads = MAX_SHARD_THREADS) {
+    if (max_threads == 0) {
+        throw invalid_argument("Thread count must be positive"s);
+    }
+    if (!loader) {
+        loader = [](const DBConfig& db_config, const QueryConfig& shard_query, stop_token stop) {
+            vector<Person> persons;
+            LoadPersons(DefaultConnectionPool(), db_config, shard_query, PERSONS_CHUNK_SIZE, [&persons](span<Person> chunk) {
+                move(chunk.begin(), chunk.end(), back_inserter(persons));
+            }, stop);
+            return persons;
+        };
+    }
+    const auto deadline = chrono::steady_clock::now() + timeout;
+
+    // Общее состояние живет, пока его держит хотя бы один поток. Строки конфигураций скопированы,
+    // потому что опоздавшие потоки переживают аргументы функции
+    struct FanOut {
+        ShardLoader loader;
+        vector<string> names;
+        vector<DBConfig> shards;
+        string name_filter;
+        QueryConfig query_config;
+        stop_source stop;
+
+        mutex state_mutex;
+        condition_variable finished;
+        size_t next_shard = 0;
+        size_t remaining = 0;
+        vector<char> done;
+        vector<vector<Person>> results;
+        vector<exception_ptr> errors;
+    };
+    auto fan_out = make_shared<FanOut>();
+    fan_out->loader = move(loader);
+    fan_out->names.reserve(shards.size());
+    for (const DBConfig& shard : shards) {
+        fan_out->names.emplace_back(shard.name);
+        fan_out->shards.push_back(shard);
+        fan_out->shards.back().name = fan_out->names.back();
+    }
+    fan_out->name_filter = query_config.name_filter;
+    fan_out->query_config = query_config;
+    fan_out->query_config.name_filter = fan_out->name_filter;
+    fan_out->remaining = shards.size();
+    fan_out->done.assign(shards.size(), false);
+    fan_out->results.resize(shards.size());
+    fan_out->errors.resize(shards.size());
+
+    const size_t thread_count = min(max_threads, shards.size());
+    try {
+        for (size_t t = 0; t < thread_count; ++t) {
+            thread([fan_out] {
+                const stop_token stop = fan_out->stop.get_token();
+                while (!stop.stop_requested()) {
+                    size_t i = 0;
+                    {
+                        lock_guard lock(fan_out->state_mutex);
+                        if (fan_out->next_shard == fan_out->shards.size()) {
+                            return;
+                        }
+                        i = fan_out->next_shard++;
+                    }
+                    vector<Person> persons;
+                    exception_ptr error;
+                    try {
+                        persons = fan_out->loader(fan_out->shards[i], fan_out->query_config, stop);
+                    }
+                    catch (...) {
+                        error = current_exception();
+                    }
+                    lock_guard lock(fan_out->state_mutex);
+                    fan_out->results[i] = move(persons);
+                    fan_out->errors[i] = error;
+                    fan_out->done[i] = true;
+                    if (--fan_out->remaining == 0) {
+                        fan_out->finished.notify_one();
+                    }
+                }
+            }).detach();
+        }
+    }
+    catch (...) {
+        // Уже запущенные потоки доберут оставшиеся базы, если им не запросить остановку
+        fan_out->stop.request_stop();
+        throw;
+    }
+
+    ShardedPersons result;
+    unique_lock lock(fan_out->state_mutex);
+    fan_out->finished.wait_until(lock, deadline, [&fan_out] {
+        return fan_out->remaining == 0;
+    });
+    // Результаты, пришедшие после срока, уже не нужны
+    fan_out->stop.request_stop();
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (fan_out->done[i] && !fan_out->errors[i]) {
+            move(fan_out->results[i].begin(), fan_out->results[i].end(), back_inserter(result.persons));
+            continue;
+        }
+        if (!shards[i].allow_exceptions) {
+            result.failed_shards.push_back(i);
+            continue;
+        }
+        if (fan_out->errors[i]) {
+            rethrow_exception(fan_out->errors[i]);
+        }
+        throw runtime_error("Database "s + fan_out->names[i] + " did not respond before the deadline"s);
+    }
+    lock.unlock();
+
+    if (order == PersonsOrder::Name) {
+        stable_sort(result.persons.begin(), result.persons.end(), [](const Person& lhs, const Person& rhs) {
+            return lhs.name < rhs.name;
+        });
+    }
+    else if (order == PersonsOrder::Age) {
+        stable_sort(result.persons.begin(), result.persons.end(), [](const Person& lhs, const Person& rhs) {
+            return lhs.age < rhs.age;
+        });
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------------------
+// Тесты пула на подмене DBConnector, которая имитирует задержку подключения,
+// потоковой загрузки на подмене DBHandler, которая выдает строки лениво,
+// и подготовленных запросов на локальной замене базы
+
+namespace tests {
+
+    // Счетчики общие для всех подмен: подмены создает сам пул
+    struct FakeConnectorStats {
+        static inline atomic<int> connects = 0;
+        // Проверки подключений к базе "slow-check" ждут, пока поднят этот флаг
+        static inline atomic<bool> hold_health_checks = false;
+        static inline atomic<int> held_health_checks = 0;
+    };
+
+    class FakeHandler {
+    public:
+        FakeHandler() = default;
+        explicit FakeHandler(bool ok, bool slow_check = false)
+            : ok_(make_shared<atomic<bool>>(ok))
+            , slow_check_(slow_check) {
+        }
+
+        // Для "slow-check" имитирует проверку, которая ходит в базу и долго не отвечает
+        bool IsOK() const {
+            if (slow_check_ && FakeConnectorStats::hold_health_checks) {
+                ++FakeConnectorStats::held_health_checks;
+                FakeConnectorStats::held_health_checks.notify_all();
+                FakeConnectorStats::hold_health_checks.wait(true);
+            }
+            return ok_ && *ok_;
+        }
+
+        // Имитирует обрыв соединения
+        void Break() {
+            *ok_ = false;
+        }
+
+    private:
+        shared_ptr<atomic<bool>> ok_;
+        bool slow_check_ = false;
+    };
+
+    // База "unreachable" недоступна: исключение или неисправное подключение, как у DBConnector
+    class FakeConnector {
+    public:
+        static constexpr chrono::milliseconds CONNECT_LATENCY{5};
+
+        FakeConnector(bool allow_exceptions, DBLogLevel)
+            : allow_exceptions_(allow_exceptions) {
+        }
+
+        FakeHandler Connect(string_view name, int) {
+            this_thread::sleep_for(CONNECT_LATENCY);
+            ++FakeConnectorStats::connects;
+            if (name == "unreachable"sv) {
+                if (allow_exceptions_) {
+                    throw runtime_error("Connection failed"s);
+                }
+                return FakeHandler(false);
+            }
+            return FakeHandler(true, name == "slow-check"sv);
+        }
+
+        FakeHandler ConnectTmp(string_view name, int timeout) {
+            return Connect(name, timeout);
+        }
+
+    private:
+        bool allow_exceptions_;
+    };
+
+    using FakePool = BasicConnectionPool<FakeConnector>;
+
+    DBConfig MakeConfig(string_view name, bool allow_exceptions = false) {
+        return DBConfig{name, 100, allow_exceptions, DBLogLevel{}};
+    }
+
+    void TestConnectionReuse() {
+        FakePool pool(4, chrono::minutes(1));
+        const int before = FakeConnectorStats::connects;
+        for (int i = 0; i < 10; ++i) {
+            FakePool::Lease db = pool.Acquire(MakeConfig("people"sv));
+            assert(db->IsOK());
+        }
+        assert(FakeConnectorStats::connects - before == 1);
+
+        // Другие настройки - другой ключ и отдельное подключение
+        {
+            FakePool::Lease first = pool.Acquire(MakeConfig("people"sv));
+            FakePool::Lease second = pool.Acquire(MakeConfig("people"sv, true));
+            FakePool::Lease third = pool.Acquire(MakeConfig("tmp.people"sv));
+        }
+        assert(FakeConnectorStats::connects - before == 3);
+    }
+
+    void TestBrokenConnectionIsReplaced() {
+        FakePool pool(1, chrono::minutes(1));
+        const int before = FakeConnectorStats::connects;
+        pool.Acquire(MakeConfig("people"sv))->Break();
+        assert(pool.Acquire(MakeConfig("people"sv))->IsOK());
+        assert(FakeConnectorStats::connects - before == 2);
+    }
+
+    void TestFailedConnectFreesSlot() {
+        // При пределе в одно подключение неудачная попытка не должна занимать место навсегда
+        FakePool pool(1, chrono::minutes(1));
+        for (int i = 0; i < 2; ++i) {
+            assert(!pool.Acquire(MakeConfig("unreachable"sv))->IsOK());
+        }
+        for (int i = 0; i < 2; ++i) {
+            bool thrown = false;
+            try {
+                FakePool::Lease db = pool.Acquire(MakeConfig("unreachable"sv, true));
+            }
+            catch (const runtime_error&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+    }
+
+    void TestIdleEviction() {
+        FakePool pool(4, chrono::milliseconds(0));
+        const int before = FakeConnectorStats::connects;
+        pool.Acquire(MakeConfig("people"sv));
+        this_thread::sleep_for(chrono::milliseconds(1));
+        pool.EvictIdle();
+        pool.Acquire(MakeConfig("people"sv));
+        assert(FakeConnectorStats::connects - before == 2);
+    }
+
+    void TestHealthCheckDoesNotBlockPool() {
+        FakePool pool(4, chrono::minutes(1));
+        pool.Acquire(MakeConfig("slow-check"sv));
+        FakeConnectorStats::hold_health_checks = true;
+        // Поток застревает в проверке свободного подключения к "slow-check"
+        jthread stuck([&pool] {
+            pool.Acquire(MakeConfig("slow-check"sv));
+        });
+        FakeConnectorStats::held_health_checks.wait(0);
+        // Пул остается доступен для других баз. Если бы проверка шла под блокировкой пула, тест бы завис
+        {
+            FakePool::Lease db = pool.Acquire(MakeConfig("people"sv));
+            assert(db->IsOK());
+        }
+        FakeConnectorStats::hold_health_checks = false;
+        FakeConnectorStats::hold_health_checks.notify_all();
+    }
+
+    // Возврат подключения к одной базе не должен доставаться тем, кто ждет другую
+    void TestWaitersOnDifferentKeys() {
+        FakePool pool(1, chrono::minutes(1));
+        optional<FakePool::Lease> held_a = pool.Acquire(MakeConfig("a"sv));
+        optional<FakePool::Lease> held_b = pool.Acquire(MakeConfig("b"sv));
+        atomic<int> b_acquired = 0;
+        atomic<bool> a_acquired = false;
+        {
+            vector<jthread> threads;
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([&] {
+                    FakePool::Lease db = pool.Acquire(MakeConfig("b"sv));
+                    ++b_acquired;
+                });
+            }
+            threads.emplace_back([&] {
+                FakePool::Lease db = pool.Acquire(MakeConfig("a"sv));
+                a_acquired = true;
+            });
+            // Даем всем ожидающим уснуть в Acquire. Если кто-то не успел, он просто найдет свободное место
+            this_thread::sleep_for(chrono::milliseconds(50));
+            held_a.reset();
+            // База b все еще занята, поэтому разбудить ждущего a может только возврат held_a.
+            // Срок нужен лишь для того, чтобы потерянное пробуждение провалило тест, а не повесило его
+            const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+            while (!a_acquired && chrono::steady_clock::now() < deadline) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            assert(a_acquired);
+            assert(b_acquired == 0);
+            held_b.reset();
+        }
+        assert(b_acquired == 4);
+    }
+
+    void TestConcurrentCheckout() {
+        constexpr size_t MAX_CONNECTIONS = 2;
+        FakePool pool(MAX_CONNECTIONS, chrono::minutes(1));
+        const int before = FakeConnectorStats::connects;
+        atomic<size_t> in_use = 0;
+        atomic<size_t> max_in_use = 0;
+        {
+            vector<jthread> threads;
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([&] {
+                    for (int i = 0; i < 50; ++i) {
+                        FakePool::Lease db = pool.Acquire(MakeConfig("people"sv));
+                        assert(db->IsOK());
+                        const size_t now_in_use = ++in_use;
+                        size_t seen = max_in_use;
+                        while (seen < now_in_use && !max_in_use.compare_exchange_weak(seen, now_in_use)) {
+                        }
+                        this_thread::yield();
+                        --in_use;
+                    }
+                });
+            }
+        }
+        assert(max_in_use <= MAX_CONNECTIONS);
+        assert(static_cast<size_t>(FakeConnectorStats::connects - before) <= MAX_CONNECTIONS);
+    }
+
+    // LoadRows возвращает ленивый диапазон и считает, сколько строк уже прочитано.
+    // Строка i - человек name_prefix + i с возрастом i % 100
+    class FakeRowsHandler {
+    public:
+        explicit FakeRowsHandler(int rows, string name_prefix = "person"s)
+            : rows_(rows)
+            , name_prefix_(move(name_prefix)) {
+        }
+
+        template <typename Name, typename Age>
+        auto LoadRows(const DBQuery&) {
+            return views::iota(0, rows_) | views::transform([this](int i) {
+                ++rows_read_;
+                return tuple<Name, Age>(name_prefix_ + to_string(i), i % 100);
+            });
+        }
+
+        int RowsRead() const {
+            return rows_read_;
+        }
+
+    private:
+        int rows_;
+        string name_prefix_;
+        int rows_read_ = 0;
+    };
+
+    void TestLoadPersonsInChunks() {
+        FakeRowsHandler db(10);
+        vector<size_t> chunk_sizes;
+        vector<Person> persons;
+        const size_t total = LoadPersonsFromDB(db, DBQuery("from Persons"s), 3, [&](span<Person> chunk) {
+            // Пачка отдается сразу, как только прочитаны ее строки
+            assert(static_cast<size_t>(db.RowsRead()) == persons.size() + chunk.size());
+            chunk_sizes.push_back(chunk.size());
+            move(chunk.begin(), chunk.end(), back_inserter(persons));
+        });
+        assert(total == 10);
+        assert((chunk_sizes == vector<size_t>{3, 3, 3, 1}));
+        for (int i = 0; i < 10; ++i) {
+            assert(persons[i].name == "person"s + to_string(i) && persons[i].age == i);
+        }
+
+        FakeRowsHandler empty_db(0);
+        assert(LoadPersonsFromDB(empty_db, DBQuery("from Persons"s), 3, [](span<Person>) { assert(false); }) == 0);
+    }
+
+    // Локальная замена базы: разбор и план запроса стоят PREPARE_COST, выполнение - EXECUTE_COST.
+    // Подготовленный запрос платит за разбор один раз, запрос с текстом - при каждом вызове.
+    // При PREPARED == false у обработчика нет Prepare, как у DBHandler
+    struct StandInCosts {
+        static constexpr chrono::microseconds PREPARE_COST{500};
+        static constexpr chrono::microseconds EXECUTE_COST{50};
+        static inline atomic<int> prepares = 0;
+    };
+
+    struct StandInStatement {
+        string text;
+    };
+
+    template <bool PREPARED>
+    class StandInHandler {
+    public:
+        static constexpr int PEOPLE = 100; // В таблице person0..person99 с возрастом, равным номеру
+
+        bool IsOK() const {
+            return true;
+        }
+
+        string Quote(string_view text) const {
+            return string(text);
+        }
+
+        StandInStatement Prepare(string_view text) requires PREPARED {
+            this_thread::sleep_for(StandInCosts::PREPARE_COST);
+            ++StandInCosts::prepares;
+            return {string(text)};
+        }
+
+        template <typename Name, typename Age>
+        vector<tuple<Name, Age>> LoadRows(const StandInStatement& statement, int min_age, int max_age, string_view name_pattern) {
+            assert(statement.text == PERSONS_QUERY);
+            this_thread::sleep_for(StandInCosts::EXECUTE_COST);
+            assert(name_pattern.size() >= 2 && name_pattern.front() == '%' && name_pattern.back() == '%');
+            const string_view name_part = name_pattern.substr(1, name_pattern.size() - 2);
+            vector<tuple<Name, Age>> rows;
+            for (int age = max(min_age, 0); age <= min(max_age, PEOPLE - 1); ++age) {
+                string name = "person"s + to_string(age);
+                if (name.find(name_part) != string::npos) {
+                    rows.emplace_back(move(name), age);
+                }
+            }
+            return rows;
+        }
+
+        // Текст запроса не разбирается: здесь важна только стоимость, отдается вся таблица
+        template <typename Name, typename Age>
+        vector<tuple<Name, Age>> LoadRows(const DBQuery&) {
+            this_thread::sleep_for(StandInCosts::PREPARE_COST + StandInCosts::EXECUTE_COST);
+            vector<tuple<Name, Age>> rows;
+            for (int age = 0; age < PEOPLE; ++age) {
+                rows.emplace_back("person"s + to_string(age), age);
+            }
+            return rows;
+        }
+    };
+
+    template <bool PREPARED>
+    class StandInConnector {
+    public:
+        StandInConnector(bool, DBLogLevel) {
+        }
+
+        StandInHandler<PREPARED> Connect(string_view, int) {
+            return {};
+        }
+
+        StandInHandler<PREPARED> ConnectTmp(string_view, int) {
+            return {};
+        }
+    };
+
+    // Prepare есть, а выполнить подготовленный запрос нечем
+    struct PrepareOnlyHandler {
+        StandInStatement Prepare(string_view text) {
+            return {string(text)};
+        }
+
+        template <typename Name, typename Age>
+        vector<tuple<Name, Age>> LoadRows(const DBQuery&) {
+            return {};
+        }
+    };
+
+    void TestPreparedStatements() {
+        static_assert(PreparedStatementHandler<StandInHandler<true>>);
+        static_assert(!PreparedStatementHandler<StandInHandler<false>>);
+        static_assert(!PreparedStatementHandler<PrepareOnlyHandler>);
+
+        BasicConnectionPool<StandInConnector<true>> pool(2, chrono::minutes(1));
+        const int before = StandInCosts::prepares;
+        for (int i = 0; i < 5; ++i) {
+            const vector<Person> persons = LoadPersons(pool, MakeConfig("people"sv), QueryConfig{10 + i, 20, "1"sv});
+            assert(persons.size() == static_cast<size_t>(10 - i));
+            for (const Person& person : persons) {
+                assert(person.age >= 10 + i && person.age <= 20 && person.name.find('1') != string::npos);
+            }
+        }
+        // Одно подключение - одна подготовка на все вызовы
+        assert(StandInCosts::prepares - before == 1);
+
+        // У каждого подключения свой кэш
+        {
+            auto first = pool.Acquire(MakeConfig("people"sv));
+            auto second = pool.Acquire(MakeConfig("people"sv));
+            StandInStatement& statement = first.Prepare(PERSONS_QUERY);
+            assert(&first.Prepare(PERSONS_QUERY) == &statement);
+            second.Prepare(PERSONS_QUERY);
+        }
+        assert(StandInCosts::prepares - before == 2);
+
+        // Без Prepare запрос уходит текстом
+        BasicConnectionPool<StandInConnector<false>> text_pool(1, chrono::minutes(1));
+        assert(LoadPersons(text_pool, MakeConfig("people"sv), QueryConfig{0, 99, ""sv}).size() == 100);
+    }
+
+    // Экранирует апострофы удвоением, как SQL
+    struct QuotingHandler {
+        string Quote(string_view text) const {
+            string quoted;
+            for (const char c : text) {
+                quoted += c;
+                if (c == '\'') {
+                    quoted += '\'';
+                }
+            }
+            return quoted;
+        }
+    };
+
+    void TestBuildPersonQueryText() {
+        QuotingHandler db;
+        for (const QueryConfig& query_config : {
+                 QueryConfig{18, 65, "Ivan"sv},
+                 QueryConfig{0, 0, ""sv},
+                 QueryConfig{-5, numeric_limits<int>::max(), "O'Brien"sv},
+                 QueryConfig{numeric_limits<int>::min(), -1, "'; drop table Persons; --"sv},
+             }) {
+            // Прежний вид запроса
+            ostringstream expected;
+            expected << "from Persons "s
+                << "select Name, Age "s
+                << "where Age between "s << query_config.min_age << " and "s << query_config.max_age << " "s
+                << "and Name like '%"s << db.Quote(query_config.name_filter) << "%'"s;
+            assert(BuildPersonQueryText(db, query_config) == expected.str());
+        }
+        assert(BuildPersonQueryText(db, QueryConfig{1, 2, "O'Brien"sv})
+               == "from Persons select Name, Age where Age between 1 and 2 and Name like '%O''Brien%'"s);
+    }
+
+    void TestPersonColumns() {
+        PersonColumns columns;
+        columns.Append("Ivan"sv, 30);
+        columns.Append(""sv, 0);
+        const vector<Person> more = {{"Maria"s, 25}, {"Anna"s, 41}};
+        columns.Append(more);
+        assert(columns.Size() == 4);
+        assert(columns.Name(0) == "Ivan"sv && columns.Name(1).empty() && columns.Name(3) == "Anna"sv);
+        assert((vector<int>(columns.Ages().begin(), columns.Ages().end()) == vector<int>{30, 0, 25, 41}));
+
+        const vector<Person> persons = columns;
+        assert(persons.size() == 4 && persons[2].name == "Maria"s && persons[2].age == 25);
+
+        // Тот же результат, что и у LoadPersons
+        BasicConnectionPool<StandInConnector<true>> pool(1, chrono::minutes(1));
+        const QueryConfig query_config{5, 60, "2"sv};
+        const vector<Person> expected = LoadPersons(pool, MakeConfig("people"sv), query_config);
+        const PersonColumns loaded = LoadPersonColumns(pool, MakeConfig("people"sv), query_config);
+        assert(loaded.Size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            assert(loaded.Name(i) == expected[i].name && loaded.Age(i) == expected[i].age);
+        }
+
+        // Строки читаются прямо в колонки
+        FakeRowsHandler db(150, "p"s);
+        const PersonColumns direct = LoadPersonColumnsFromDB(db, DBQuery("from Persons"s));
+        assert(db.RowsRead() == 150 && direct.Size() == 150);
+        assert(direct.Name(0) == "p0"sv && direct.Name(149) == "p149"sv && direct.Age(149) == 49);
+    }
+
+    // Подмена баз для LoadPersonsSharded со счетчиками одновременных загрузок
+    struct FakeShardStats {
+        mutex stats_mutex;
+        condition_variable_any changed;
+        int gate = 0; // Загрузка ждет, пока одновременно не начнутся gate загрузок
+        int in_flight = 0;
+        int max_in_flight = 0;
+        int stopped = 0;
+        bool release_stuck = false;
+    };
+
+    // У каждой базы свои люди. База с именем, начинающимся на "broken", выбрасывает исключение,
+    // на "slow" - не отвечает, пока ей не запросят остановку, на "stuck" - не отвечает и на остановку,
+    // пока не поднят release_stuck, как драйвер посреди вызова.
+    // Опоздавшие загрузки переживают LoadPersonsSharded, поэтому счетчики принадлежат и загрузчику
+    ShardLoader MakeFakeShards(map<string, vector<Person>> shards, shared_ptr<FakeShardStats> stats) {
+        return [shards = move(shards), stats](const DBConfig& db_config, const QueryConfig&, stop_token stop) {
+            unique_lock lock(stats->stats_mutex);
+            ++stats->in_flight;
+            stats->max_in_flight = max(stats->max_in_flight, stats->in_flight);
+            stats->changed.notify_all();
+            const bool opened = stats->changed.wait(lock, stop, [&stats] {
+                return stats->max_in_flight >= stats->gate;
+            });
+            if (opened && db_config.name.starts_with("slow"sv)) {
+                stats->changed.wait(lock, stop, [] {
+                    return false;
+                });
+            }
+            if (opened && db_config.name.starts_with("stuck"sv)) {
+                stats->changed.wait(lock, [&stats] {
+                    return stats->release_stuck;
+                });
+            }
+            --stats->in_flight;
+            stats->changed.notify_all();
+            if (stop.stop_requested()) {
+                ++stats->stopped;
+                throw runtime_error("Stopped"s);
+            }
+            if (db_config.name.starts_with("broken"sv)) {
+                throw runtime_error("Shard is down"s);
+            }
+            return shards.at(string(db_config.name));
+        };
+    }
+
+    // Ждет, пока опоздавшие загрузки не завершатся и остановленных не станет stopped
+    void WaitShardsStopped(FakeShardStats& stats, int stopped) {
+        unique_lock lock(stats.stats_mutex);
+        stats.changed.wait(lock, [&stats, stopped] {
+            return stats.in_flight == 0 && stats.stopped == stopped;
+        });
+    }
+
+    void TestLoadPersonsSharded() {
+        using namespace chrono_literals;
+        const auto stats = make_shared<FakeShardStats>();
+        const ShardLoader loader = MakeFakeShards({
+            {"a"s, {{"Petr"s, 40}, {"Anna"s, 20}}},
+            {"b"s, {{"Boris"s, 30}}},
+            {"c"s, {{"Vera"s, 20}}},
+            {"d"s, {}},
+            {"e"s, {}},
+            {"f"s, {{"Fedor"s, 50}}},
+            {"slow"s, {{"Late"s, 1}}},
+            {"stuck"s, {{"Late"s, 1}}},
+            {"broken"s, {}},
+        }, stats);
+        const QueryConfig query_config{0, 100, ""sv};
+        const vector<DBConfig> abc = {MakeConfig("a"sv), MakeConfig("b"sv), MakeConfig("c"sv)};
+
+        // Базы опрашиваются одновременно: каждая загрузка ждет, пока начнутся все три,
+        // и при загрузке по очереди ни одна не дождалась бы срока
+        stats->gate = 3;
+        ShardedPersons result = LoadPersonsSharded(abc, query_config, 1min, PersonsOrder::Shards, loader);
+        assert(result.failed_shards.empty());
+        vector<string> names;
+        for (const Person& person : result.persons) {
+            names.push_back(person.name);
+        }
+        assert((names == vector<string>{"Petr"s, "Anna"s, "Boris"s, "Vera"s}));
+
+        // Потоков не больше max_threads, и все базы все равно загружаются
+        stats->gate = 2;
+        stats->max_in_flight = 0;
+        result = LoadPersonsSharded({MakeConfig("a"sv), MakeConfig("b"sv), MakeConfig("c"sv), MakeConfig("d"sv),
+                                     MakeConfig("e"sv), MakeConfig("f"sv)},
+                                    query_config, 1min, PersonsOrder::Shards, loader, 2);
+        assert(stats->max_in_flight == 2);
+        assert(result.failed_shards.empty() && result.persons.size() == 5);
+        stats->gate = 0;
+
+        // Сортировка устойчива: Anna раньше Vera, как и их базы
+        result = LoadPersonsSharded(abc, query_config, 1min, PersonsOrder::Age, loader);
+        assert(result.persons[0].name == "Anna"s && result.persons[1].name == "Vera"s && result.persons[3].age == 40);
+        result = LoadPersonsSharded({MakeConfig("a"sv), MakeConfig("b"sv)}, query_config, 1min, PersonsOrder::Name, loader);
+        assert(result.persons[0].name == "Anna"s && result.persons[2].name == "Petr"s);
+
+        // Без исключений опоздавшая и сломанная базы попадают в failed_shards. Опоздавшей загрузке
+        // запрошена остановка
+        result = LoadPersonsSharded({MakeConfig("slow"sv), MakeConfig("a"sv), MakeConfig("broken"sv)},
+                                    query_config, 200ms, PersonsOrder::Shards, loader);
+        assert((result.failed_shards == vector<size_t>{0, 2}));
+        assert(result.persons.size() == 2);
+        WaitShardsStopped(*stats, 1);
+
+        // С исключениями ошибка базы или опоздание выбрасываются, опоздавшая загрузка остановлена
+        for (const string_view shard : {"broken"sv, "slow"sv}) {
+            bool thrown = false;
+            try {
+                LoadPersonsSharded({MakeConfig("a"sv), MakeConfig(shard, true)}, query_config, 200ms, PersonsOrder::Shards, loader);
+            }
+            catch (const runtime_error&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+        WaitShardsStopped(*stats, 2);
+
+        // Загрузка, которая не отзывается на остановку, не задерживает ни результат, ни исключение:
+        // к возврату она все еще идет и завершается уже потом
+        result = LoadPersonsSharded({MakeConfig("stuck"sv), MakeConfig("a"sv)}, query_config, 200ms, PersonsOrder::Shards, loader);
+        assert((result.failed_shards == vector<size_t>{0}) && result.persons.size() == 2);
+        bool thrown = false;
+        try {
+            LoadPersonsSharded({MakeConfig("stuck"sv, true)}, query_config, 200ms, PersonsOrder::Shards, loader);
+        }
+        catch (const runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+        {
+            lock_guard lock(stats->stats_mutex);
+            assert(stats->in_flight == 2);
+            stats->release_stuck = true;
+        }
+        stats->changed.notify_all();
+        WaitShardsStopped(*stats, 4);
+
+        thrown = false;
+        try {
+            LoadPersonsSharded(abc, query_config, 1min, PersonsOrder::Shards, loader, 0);
+        }
+        catch (const invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // Ожидание подключения в пуле прерывается остановкой
+    void TestAcquireStops() {
+        FakePool pool(1, chrono::minutes(1));
+        const FakePool::Lease held = pool.Acquire(MakeConfig("people"sv));
+        stop_source stop;
+        atomic<bool> stopped = false;
+        jthread waiter([&] {
+            try {
+                pool.Acquire(MakeConfig("people"sv), stop.get_token());
+            }
+            catch (const LoadStopped&) {
+                stopped = true;
+            }
+        });
+        this_thread::sleep_for(chrono::milliseconds(50));
+        assert(!stopped);
+        stop.request_stop();
+        waiter.join();
+        assert(stopped);
+
+        // Загрузка с остановкой посреди выборки не отдает следующую пачку
+        BasicConnectionPool<StandInConnector<true>> people_pool(1, chrono::minutes(1));
+        stop_source stop_load;
+        size_t seen = 0;
+        bool thrown = false;
+        try {
+            LoadPersons(people_pool, MakeConfig("people"sv), QueryConfig{0, 99, ""sv}, 4, [&](span<Person> chunk) {
+                seen += chunk.size();
+                stop_load.request_stop();
+            }, stop_load.get_token());
+        }
+        catch (const LoadStopped&) {
+            thrown = true;
+        }
+        assert(thrown && seen == 4);
+    }
+
+    void TestConnectionPool() {
+        TestConnectionReuse();
+        TestBrokenConnectionIsReplaced();
+        TestFailedConnectFreesSlot();
+        TestIdleEviction();
+        TestHealthCheckDoesNotBlockPool();
+        TestWaitersOnDifferentKeys();
+        TestAcquireStops();
+        TestConcurrentCheckout();
+    }
+
+    void TestAll() {
+        TestConnectionPool();
+        TestLoadPersonsInChunks();
+        TestPreparedStatements();
+        TestBuildPersonQueryText();
+        TestPersonColumns();
+        TestLoadPersonsSharded();
+    }
+
+}//!namespace tests
+
+#include "HeapStats.h"
+
+namespace bench {
+
+    // Средняя задержка LoadPersons на локальной замене базы, в микросекундах
+    template <bool PREPARED>
+    pair<double, vector<Person>> MeanLoadPersonsLatency(int queries) {
+        BasicConnectionPool<tests::StandInConnector<PREPARED>> pool(1, chrono::minutes(1));
+        const DBConfig db_config = tests::MakeConfig("people"sv);
+        // Заменитель базы не разбирает текст запроса и отдает всю таблицу, поэтому оба пути
+        // сравниваются на условии, под которое попадает вся таблица
+        const QueryConfig query_config{0, tests::StandInHandler<PREPARED>::PEOPLE - 1, ""sv};
+        // Подключение и подготовка запроса не входят в замер
+        vector<Person> persons = LoadPersons(pool, db_config, query_config);
+
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < queries; ++i) {
+            persons = LoadPersons(pool, db_config, query_config);
+        }
+        const auto elapsed = chrono::steady_clock::now() - start;
+        return { chrono::duration<double, micro>(elapsed).count() / queries, move(persons) };
+    }
+
+    // Подготовленный запрос против запроса со значениями в тексте на одной и той же выборке
+    void PreparedVsTextQuery(ostream& out, int queries = 200) {
+        const auto [prepared_us, prepared_persons] = MeanLoadPersonsLatency<true>(queries);
+        const auto [text_us, text_persons] = MeanLoadPersonsLatency<false>(queries);
+        assert(prepared_persons.size() == static_cast<size_t>(tests::StandInHandler<true>::PEOPLE));
+        assert(ranges::equal(prepared_persons, text_persons, [](const Person& lhs, const Person& rhs) {
+            return lhs.name == rhs.name && lhs.age == rhs.age;
+        }));
+        out << "prepared_us\ttext_us\n"s;
+        out << prepared_us << '\t' << text_us << '\n';
+    }
+
+    // Куча при загрузке и после нее и скорость перебора по возрасту: vector<Person> против PersonColumns.
+    // Строки отдает FakeRowsHandler с именами длиннее буфера короткой строки, как у настоящих ФИО.
+    // Выделения и блоки считаются заменой operator new из HeapStats.cpp: allocations - сколько раз
+    // выделялась память во время загрузки, blocks и mb - что держит результат после нее
+    void ColumnarVsPersons(ostream& out, int rows = 1'000'000, int passes = 20) {
+        const string name_prefix = "Person Surname Patronymic "s;
+        const DBQuery query("from Persons"s);
+        struct HeapUse {
+            size_t allocations;
+            size_t blocks;
+            size_t bytes;
+        };
+        const auto measure_load = [&](auto&& load) {
+            tests::FakeRowsHandler db(rows, name_prefix);
+            const size_t allocations_before = heap_stats::Allocations();
+            const size_t blocks_before = heap_stats::BlocksInUse();
+            const size_t bytes_before = heap_stats::BytesInUse();
+            auto result = load(db);
+            return pair{ move(result), HeapUse{ heap_stats::Allocations() - allocations_before,
+                                                heap_stats::BlocksInUse() - blocks_before,
+                                                heap_stats::BytesInUse() - bytes_before } };
+        };
+        auto [persons, persons_heap] = measure_load([&](tests::FakeRowsHandler& db) {
+            vector<Person> persons;
+            LoadPersonsFromDB(db, query, PERSONS_CHUNK_SIZE, [&persons](span<Person> chunk) {
+                move(chunk.begin(), chunk.end(), back_inserter(persons));
+            });
+            return persons;
+        });
+        const auto [columns, columns_heap] = measure_load([&](tests::FakeRowsHandler& db) {
+            return LoadPersonColumnsFromDB(db, query);
+        });
+        assert(persons.size() == columns.Size());
+
+        const auto measure_scan = [passes](auto&& scan) {
+            const auto start = chrono::steady_clock::now();
+            size_t checksum = 0;
+            for (int pass = 0; pass < passes; ++pass) {
+                checksum += scan(pass % 90);
+            }
+            const auto elapsed = chrono::steady_clock::now() - start;
+            return pair{ chrono::duration<double, milli>(elapsed).count() / passes, checksum };
+        };
+        // Люди в десятилетнем диапазоне возрастов и суммарная длина их имен
+        const auto [persons_ms, persons_sum] = measure_scan([&](int min_age) {
+            size_t sum = 0;
+            for (const Person& person : persons) {
+                if (person.age >= min_age && person.age < min_age + 10) {
+                    sum += person.name.size();
+                }
+            }
+            return sum;
+        });
+        const auto [columns_ms, columns_sum] = measure_scan([&](int min_age) {
+            size_t sum = 0;
+            const span<const int> ages = columns.Ages();
+            for (size_t i = 0; i < ages.size(); ++i) {
+                if (ages[i] >= min_age && ages[i] < min_age + 10) {
+                    sum += columns.Name(i).size();
+                }
+            }
+            return sum;
+        });
+        assert(persons_sum == columns_sum);
+
+        out << "layout\tallocations\tblocks\tmb\tscan_ms\n"s;
+        for (const auto& [name, heap, scan_ms] : { tuple{ "persons"sv, persons_heap, persons_ms },
+                                                   tuple{ "columns"sv, columns_heap, columns_ms } }) {
+            out << name << '\t' << heap.allocations << '\t' << heap.blocks << '\t' << heap.bytes / 1e6
+                << '\t' << scan_ms << '\n';
+        }
+    }
+
+}//!namespace bench
@@ -0,0 +1,130 @@
+// Запуск тестов и замеров LoadPerson.cpp. Сам LoadPerson.cpp - фрагмент программы: DBHandler,
+// DBConnector, DBQuery, Person и DBLogLevel приходят из драйвера базы. Здесь они заменены
+// минимальными заглушками с тем же интерфейсом, а все остальное - код из LoadPerson.cpp как есть.
+// Сборка: g++ -std=c++20 -O2 LoadPersonMain.cpp HeapStats.cpp -pthread
+// HeapStats.cpp заменяет operator new ради счетчиков в замерах, тесты работают и без него
+// Без ключей выполняются тесты, с ключом --bench после них еще и замеры
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//------------------------------------------------------
+//-------------------Driver stand-ins-------------------
+//------------------------------------------------------
+
+enum class DBLogLevel {
+    Normal,
+    Verbose
+};
+
+class DBQuery {
+public:
+    explicit DBQuery(string query)
+        : query_(move(query)) {
+    }
+
+    const string& Text() const {
+        return query_;
+    }
+
+private:
+    string query_;
+};
+
+struct Person {
+    string name;
+    int age;
+};
+
+// В таблице один человек, запрос не разбирается
+class DBHandler {
+public:
+    bool IsOK() const {
+        return true;
+    }
+
+    string Quote(string_view text) const {
+        return string(text);
+    }
+
+    template <typename... Types>
+    vector<tuple<Types...>> LoadRows(const DBQuery&) {
+        return {{"Ann"s, 30}};
+    }
+};
+
+class DBConnector {
+public:
+    DBConnector(bool, DBLogLevel) {
+    }
+
+    DBHandler Connect(string_view, int) {
+        return {};
+    }
+
+    DBHandler ConnectTmp(string_view, int) {
+        return {};
+    }
+};
+
+#include "LoadPerson.cpp"
+
+namespace tests {
+
+    // Пути через настоящий интерфейс DBHandler: пул по умолчанию и запрос текстом
+    void TestWithDBHandler() {
+        const DBConfig db_config{"people"sv, 1, false, DBLogLevel::Normal};
+        const QueryConfig query_config{0, 100, ""sv};
+        assert(LoadPersons(db_config, query_config).size() == 1);
+        size_t seen = 0;
+        assert(LoadPersons(DefaultConnectionPool(), db_config, query_config, 4, [&seen](span<Person> chunk) {
+            seen += chunk.size();
+        }) == 1);
+        assert(seen == 1);
+        assert(LoadPersonColumns(DefaultConnectionPool(), db_config, query_config).Size() == 1);
+
+        // Загрузчик по умолчанию для нескольких баз
+        const ShardedPersons sharded = LoadPersonsSharded({db_config, db_config}, query_config, chrono::minutes(1));
+        assert(sharded.failed_shards.empty() && sharded.persons.size() == 2);
+    }
+
+}//!namespace tests
+
+int main(int argc, char* argv[]) {
+    tests::TestAll();
+    tests::TestWithDBHandler();
+    if (argc > 1 && argv[1] == "--bench"sv) {
+        bench::PreparedVsTextQuery(cout);
+        bench::ColumnarVsPersons(cout);
+    }
+    return 0;
+}
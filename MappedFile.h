@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Файл, отображенный в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view Data() const noexcept;
+    // Отдает системе страницы, целиком лежащие до позиции end: они прочитаны и больше не нужны
+    void Release(size_t end) noexcept;
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    size_t released_ = 0;
+};
+
+inline MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) < 0) {
+        const int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    // Пустой файл отобразить нельзя, но и читать в нем нечего
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED) {
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+        // Файл читается один раз от начала до конца
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    // Отображение остается действительным и после закрытия дескриптора
+    close(fd);
+}
+
+inline MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+inline std::string_view MappedFile::Data() const noexcept {
+    return { static_cast<const char*>(data_), size_ };
+}
+
+inline void MappedFile::Release(size_t end) noexcept {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t release_end = std::min(end, size_) / page_size * page_size;
+    if (release_end > released_) {
+        // Страницы только для чтения: при повторном обращении они снова прочитаются из файла
+        madvise(static_cast<char*>(data_) + released_, release_end - released_, MADV_DONTNEED);
+        released_ = release_end;
+    }
+}
+
+// Временный файл с уникальным именем, созданный через mkstemp. Удаляется вместе с объектом,
+// поэтому одновременно запущенные тесты не затирают файлы друг друга
+class TempFile {
+public:
+    // Имя файла во временном каталоге начинается с prefix
+    explicit TempFile(std::string_view prefix);
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+    ~TempFile();
+
+    const std::string& Path() const noexcept;
+
+private:
+    std::string path_;
+};
+
+inline TempFile::TempFile(std::string_view prefix)
+    : path_((std::filesystem::temp_directory_path() / prefix).string() + "XXXXXX") {
+    const int fd = mkstemp(path_.data());
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path_);
+    }
+    close(fd);
+}
+
+inline TempFile::~TempFile() {
+    unlink(path_.c_str());
+}
+
+inline const std::string& TempFile::Path() const noexcept {
+    return path_;
+}
@@ -1,13 +1,28 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+#include "MappedFile.h"
 
 using namespace std;
 
 struct Country {
 public:
     // Добавляем языки из списка к стране
-    void AddLanguages(const std::list<Language>& lang_list) {
+    void AddLanguages(const std::list<Json>& lang_list) {
         for (const auto& lang_obj : lang_list) {
             languages.push_back(FromString<Language>(lang_obj.AsString()));
         }
@@ -22,33 +37,36 @@ public:
 
 class CityBuilder {
 public:
-    CityBuilder& SetName(const std::string& name) {
+    CityBuilder& SetName(std::string_view name) {
         name_ = name;
         return *this;
     }
-    CityBuilder& SetIsoCode(const std::string& iso_code) {
+    CityBuilder& SetIsoCode(std::string_view iso_code) {
         iso_code_ = iso_code;
         return *this;
     }
-    // Устанавливаем общий телефонный код, объединяя код страны и код города
-    CityBuilder& SetPhoneCode(const std::string& country_phone_code, const std::string& city_phone_code) {
-        phone_code_ = country_phone_code + city_phone_code;
+    // Устанавливаем общий телефонный код, объединяя код страны и код города.
+    // Код собирается прямо в поле билдера, без временной строки-суммы
+    CityBuilder& SetPhoneCode(std::string_view country_phone_code, std::string_view city_phone_code) {
+        phone_code_.reserve(country_phone_code.size() + city_phone_code.size());
+        phone_code_.assign(country_phone_code);
+        phone_code_.append(city_phone_code);
         return *this;
     }
-    CityBuilder& SetCountryName(const std::string& country_name) {
+    CityBuilder& SetCountryName(std::string_view country_name) {
         country_name_ = country_name;
         return *this;
     }
-    CityBuilder& SetCountryIsoCode(const std::string& country_iso_code) {
+    CityBuilder& SetCountryIsoCode(std::string_view country_iso_code) {
         country_iso_code_ = country_iso_code;
         return *this;
     }
-    CityBuilder& SetTimeZone(const std::string& time_zone) {
+    CityBuilder& SetTimeZone(std::string_view time_zone) {
         time_zone_ = time_zone;
         return *this;
     }
     CityBuilder& SetLanguage(const std::vector<Language>& language) {
-        language_ = language;
+        languages_ = language;
         return *this;
     }
 
@@ -65,6 +83,19 @@ public:
         };
     }
 
+    // То же, но поля переносятся в город без копирования, а билдер остается пустым
+    City Build() {
+        return {
+            std::move(name_),
+            std::move(iso_code_),
+            std::move(phone_code_),
+            std::move(country_name_),
+            std::move(country_iso_code_),
+            std::move(time_zone_),
+            std::move(languages_)
+        };
+    }
+
 private:
     std::string name_;
     std::string iso_code_;
@@ -75,6 +106,38 @@ private:
     std::vector<Language> languages_;
 };
 
+// Город без копии данных своей страны: вместо названия, кода, часового пояса и языков страны
+// хранится ее номер в векторе стран. Все города страны разделяют одну запись Country
+struct CompactCity {
+    std::string name;
+    std::string iso_code;
+    std::string phone_code; // Полный код, как в City: код страны и код города
+    size_t country_index;
+};
+
+CompactCity MakeCompactCity(std::string name, std::string iso_code, std::string_view country_phone_code,
+                            std::string_view city_phone_code, size_t country_index) {
+    CompactCity city{ std::move(name), std::move(iso_code), {}, country_index };
+    city.phone_code.reserve(country_phone_code.size() + city_phone_code.size());
+    city.phone_code.assign(country_phone_code);
+    city.phone_code.append(city_phone_code);
+    return city;
+}
+
+// Полный City для кода, который работает с ним
+City ExpandCity(const CompactCity& city, const std::vector<Country>& countries) {
+    const Country& country = countries[city.country_index];
+    return {
+        city.name,
+        city.iso_code,
+        city.phone_code,
+        country.name,
+        country.iso_code,
+        country.time_zone,
+        country.languages
+    };
+}
+
 // Функция ParseCitySubjson обрабатывает JSON-объект со списком городов конкретной страны:
 void ParseCitySubjson(vector<City>& cities, const Json& json, const Country& country) {
     for (const auto& city_json : json.AsList()) {
@@ -88,33 +151,1077 @@ void ParseCitySubjson(vector<City>& cities, const Json& json, const Country& cou
             .SetCountryName(country.name)
             .SetCountryIsoCode(country.iso_code)
             .SetTimeZone(country.time_zone)
-            .SetLanguage(country.languages);
+            .SetLanguage(country.languages)
+            .Build();
 
         // Добавляем город в вектор городов
         cities.push_back(std::move(city));
     }
 }
 
+// Создаем объект страны по JSON-объекту, без ее городов
+Country ReadCountry(const Json& country_obj) {
+    Country country{
+        .name = country_obj["name"s].AsString(),
+        .iso_code = country_obj["iso_code"s].AsString(),
+        .phone_code = country_obj["phone_code"s].AsString(),
+        .time_zone = country_obj["time_zone"s].AsString(),
+        .languages = {}
+    };
+
+    // Добавляем языки к стране
+    country.AddLanguages(country_obj["languages"s].AsList());
+    return country;
+}
+
 // Функция ParseCitySubjson вызывается только из функции ParseCountryJson следующим образом:
 void ParseCountryJson(vector<Country>& countries, vector<City>& cities, const Json& json) {
     for (const auto& country_json : json.AsList()) {
         const auto& country_obj = country_json.AsObject();
 
-        // Создаем объект страны
-        Country country{
-            .name = country_obj["name"s].AsString(),
-            .iso_code = country_obj["iso_code"s].AsString(),
-            .phone_code = country_obj["phone_code"s].AsString(),
-            .time_zone = country_obj["time_zone"s].AsString()
-        };
-
-        // Добавляем языки к стране
-        country.AddLanguages(country_obj["languages"s].AsList());
-
         // Добавляем страну в вектор стран
-        countries.push_back(std::move(country));
+        countries.push_back(ReadCountry(country_obj));
 
         // Обрабатываем города для данной страны
         ParseCitySubjson(cities, country_obj["cities"s], countries.back());
     }
 }
+
+// Вариант ParseCitySubjson, который не копирует данные страны в каждый город
+void ParseCitySubjson(vector<CompactCity>& cities, const Json& json, const Country& country, size_t country_index) {
+    for (const auto& city_json : json.AsList()) {
+        const auto& city_obj = city_json.AsObject();
+        cities.push_back(MakeCompactCity(city_obj["name"s].AsString(), city_obj["iso_code"s].AsString(),
+                                         country.phone_code, city_obj["phone_code"s].AsString(), country_index));
+    }
+}
+
+// Вариант ParseCountryJson с городами в виде CompactCity
+void ParseCountryJson(vector<Country>& countries, vector<CompactCity>& cities, const Json& json) {
+    for (const auto& country_json : json.AsList()) {
+        const auto& country_obj = country_json.AsObject();
+        countries.push_back(ReadCountry(country_obj));
+        ParseCitySubjson(cities, country_obj["cities"s], countries.back(), countries.size() - 1);
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// Потоковый разбор: Country и City заполняются прямо по ходу чтения текста, без дерева Json.
+// Файл отображается в память, прочитанные страницы сразу отдаются системе, поэтому кроме
+// результата в памяти держатся только поля городов одной текущей страны
+
+// Ошибка в тексте JSON, в сообщении - смещение от начала текста
+class JsonSyntaxError : public std::runtime_error {
+public:
+    JsonSyntaxError(const std::string& message, size_t offset);
+};
+
+JsonSyntaxError::JsonSyntaxError(const std::string& message, size_t offset)
+    : std::runtime_error(message + " at offset "s + std::to_string(offset)) {
+}
+
+// Чтение JSON по одному значению без построения дерева. Вызывающий сам знает, какое значение
+// ожидает дальше: строку, массив или объект, - а ненужные значения пропускает через SkipValue
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text);
+    // Чтение значения, которое занимает [begin, end) в text. Смещения в ошибках - от начала text
+    JsonReader(std::string_view text, size_t begin, size_t end);
+
+    // on_element() вызывается для каждого элемента массива и должен прочитать его целиком
+    template <typename OnElement>
+    void ReadArray(OnElement&& on_element);
+    // on_member(key) вызывается для каждого поля объекта и должен прочитать его значение.
+    // key действителен только до чтения значения
+    template <typename OnMember>
+    void ReadObject(OnMember&& on_member);
+    // Строка с раскрытыми escape-последовательностями, действительна до следующего чтения
+    std::string_view ReadString();
+    // Пропуск значения любого типа с полной проверкой синтаксиса, но без сохранения содержимого
+    void SkipValue();
+    // После значения верхнего уровня остались только пробельные символы
+    void ExpectEnd();
+    size_t Position() const noexcept;
+
+private:
+    void SkipWhitespace() noexcept;
+    // Следующий значащий символ без его чтения
+    char PeekToken();
+    void Expect(char c);
+    bool TryConsume(char c);
+    // Строка с позиции открывающей кавычки. Без escape-последовательностей - подстрока текста, иначе копия в buffer
+    std::string_view ParseString(std::string& buffer);
+    // Ключ объекта вместе с двоеточием внутри пропускаемого значения
+    void SkipKey();
+    void SkipLiteral(std::string_view literal);
+    void SkipNumber();
+    void AppendEscaped(std::string& buffer);
+    uint32_t ReadHex4();
+    [[noreturn]] void Fail(const char* message) const;
+
+    std::string_view text_;
+    size_t pos_ = 0;
+    std::string key_buffer_;   // Ключ и значение раскрываются в разные буферы:
+    std::string value_buffer_; // ключ еще нужен, пока читается значение
+};
+
+JsonReader::JsonReader(std::string_view text)
+    : text_(text) {
+}
+
+JsonReader::JsonReader(std::string_view text, size_t begin, size_t end)
+    : text_(text.substr(0, end))
+    , pos_(begin) {
+}
+
+template <typename OnElement>
+void JsonReader::ReadArray(OnElement&& on_element) {
+    Expect('[');
+    if (TryConsume(']')) {
+        return;
+    }
+    do {
+        on_element();
+    } while (TryConsume(','));
+    Expect(']');
+}
+
+template <typename OnMember>
+void JsonReader::ReadObject(OnMember&& on_member) {
+    Expect('{');
+    if (TryConsume('}')) {
+        return;
+    }
+    do {
+        if (PeekToken() != '"') {
+            Fail("Expected object key");
+        }
+        const std::string_view key = ParseString(key_buffer_);
+        Expect(':');
+        on_member(key);
+    } while (TryConsume(','));
+    Expect('}');
+}
+
+std::string_view JsonReader::ReadString() {
+    if (PeekToken() != '"') {
+        Fail("Expected string");
+    }
+    return ParseString(value_buffer_);
+}
+
+void JsonReader::SkipValue() {
+    // Закрывающие скобки еще не закрытых массивов и объектов. Стек вместо рекурсии:
+    // глубину пропускаемого значения не ограничивает стек вызовов
+    std::string closers;
+    while (true) {
+        // Здесь ожидается очередное значение
+        switch (PeekToken()) {
+        case '"':
+            ParseString(value_buffer_);
+            break;
+        case '[':
+            ++pos_;
+            if (TryConsume(']')) {
+                break;
+            }
+            closers.push_back(']');
+            continue;
+        case '{':
+            ++pos_;
+            if (TryConsume('}')) {
+                break;
+            }
+            closers.push_back('}');
+            SkipKey();
+            continue;
+        case 't':
+            SkipLiteral("true"sv);
+            break;
+        case 'f':
+            SkipLiteral("false"sv);
+            break;
+        case 'n':
+            SkipLiteral("null"sv);
+            break;
+        default:
+            SkipNumber();
+            break;
+        }
+        // Значение прочитано: за ним идет запятая или закрывается объемлющая скобка
+        while (true) {
+            if (closers.empty()) {
+                return;
+            }
+            if (TryConsume(',')) {
+                if (closers.back() == '}') {
+                    SkipKey();
+                }
+                break;
+            }
+            Expect(closers.back());
+            closers.pop_back();
+        }
+    }
+}
+
+void JsonReader::ExpectEnd() {
+    SkipWhitespace();
+    if (pos_ != text_.size()) {
+        Fail("Unexpected characters after JSON value");
+    }
+}
+
+size_t JsonReader::Position() const noexcept {
+    return pos_;
+}
+
+void JsonReader::SkipWhitespace() noexcept {
+    while (pos_ < text_.size()
+           && (text_[pos_] == ' ' || text_[pos_] == '\n' || text_[pos_] == '\r' || text_[pos_] == '\t')) {
+        ++pos_;
+    }
+}
+
+char JsonReader::PeekToken() {
+    SkipWhitespace();
+    if (pos_ == text_.size()) {
+        Fail("Unexpected end of JSON");
+    }
+    return text_[pos_];
+}
+
+void JsonReader::Expect(char c) {
+    if (PeekToken() != c) {
+        Fail("Unexpected character");
+    }
+    ++pos_;
+}
+
+bool JsonReader::TryConsume(char c) {
+    SkipWhitespace();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+        ++pos_;
+        return true;
+    }
+    return false;
+}
+
+std::string_view JsonReader::ParseString(std::string& buffer) {
+    const size_t start = ++pos_;
+    // Обычно escape-последовательностей нет, и строка возвращается без копирования
+    while (pos_ < text_.size()) {
+        const char c = text_[pos_];
+        if (c == '"') {
+            return text_.substr(start, pos_++ - start);
+        }
+        if (c == '\\') {
+            break;
+        }
+        if (static_cast<unsigned char>(c) < 0x20) {
+            Fail("Control character in string");
+        }
+        ++pos_;
+    }
+    buffer.assign(text_.substr(start, pos_ - start));
+    while (pos_ < text_.size()) {
+        const char c = text_[pos_++];
+        if (c == '"') {
+            return buffer;
+        }
+        if (c == '\\') {
+            AppendEscaped(buffer);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            Fail("Control character in string");
+        }
+        else {
+            buffer.push_back(c);
+        }
+    }
+    Fail("Unterminated string");
+}
+
+void JsonReader::SkipKey() {
+    if (PeekToken() != '"') {
+        Fail("Expected object key");
+    }
+    ParseString(value_buffer_);
+    Expect(':');
+}
+
+void JsonReader::SkipLiteral(std::string_view literal) {
+    if (text_.substr(pos_, literal.size()) != literal) {
+        Fail("Invalid literal");
+    }
+    pos_ += literal.size();
+}
+
+void JsonReader::SkipNumber() {
+    const auto skip_digits = [this] {
+        const size_t start = pos_;
+        while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+            ++pos_;
+        }
+        return pos_ > start;
+    };
+    const auto try_skip = [this](char c) {
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    };
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    const bool negative = try_skip('-');
+    if (!try_skip('0') && !skip_digits()) {
+        Fail(negative ? "Invalid number" : "Expected value");
+    }
+    if (try_skip('.') && !skip_digits()) {
+        Fail("Invalid number");
+    }
+    if (try_skip('e') || try_skip('E')) {
+        if (!try_skip('+')) {
+            try_skip('-');
+        }
+        if (!skip_digits()) {
+            Fail("Invalid number");
+        }
+    }
+}
+
+void JsonReader::AppendEscaped(std::string& buffer) {
+    if (pos_ == text_.size()) {
+        Fail("Unterminated string");
+    }
+    switch (const char c = text_[pos_++]) {
+    case '"':
+    case '\\':
+    case '/':
+        buffer.push_back(c);
+        return;
+    case 'b':
+        buffer.push_back('\b');
+        return;
+    case 'f':
+        buffer.push_back('\f');
+        return;
+    case 'n':
+        buffer.push_back('\n');
+        return;
+    case 'r':
+        buffer.push_back('\r');
+        return;
+    case 't':
+        buffer.push_back('\t');
+        return;
+    case 'u':
+        break;
+    default:
+        Fail("Invalid escape sequence");
+    }
+
+    uint32_t code = ReadHex4();
+    if (code >= 0xDC00 && code <= 0xDFFF) {
+        Fail("Unpaired surrogate");
+    }
+    // Символ вне базовой плоскости записан суррогатной парой
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        if (text_.substr(pos_, 2) != "\\u"sv) {
+            Fail("Unpaired surrogate");
+        }
+        pos_ += 2;
+        const uint32_t low = ReadHex4();
+        if (low < 0xDC00 || low > 0xDFFF) {
+            Fail("Unpaired surrogate");
+        }
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    // Кодирование в UTF-8
+    if (code < 0x80) {
+        buffer.push_back(static_cast<char>(code));
+    }
+    else if (code < 0x800) {
+        buffer.push_back(static_cast<char>(0xC0 | code >> 6));
+        buffer.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    else if (code < 0x10000) {
+        buffer.push_back(static_cast<char>(0xE0 | code >> 12));
+        buffer.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+        buffer.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    else {
+        buffer.push_back(static_cast<char>(0xF0 | code >> 18));
+        buffer.push_back(static_cast<char>(0x80 | (code >> 12 & 0x3F)));
+        buffer.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+        buffer.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+uint32_t JsonReader::ReadHex4() {
+    if (text_.size() - pos_ < 4) {
+        Fail("Invalid unicode escape");
+    }
+    uint32_t code = 0;
+    for (int i = 0; i < 4; ++i) {
+        const char c = text_[pos_++];
+        uint32_t digit = 0;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        }
+        else {
+            Fail("Invalid unicode escape");
+        }
+        code = code << 4 | digit;
+    }
+    return code;
+}
+
+void JsonReader::Fail(const char* message) const {
+    throw JsonSyntaxError(message, pos_);
+}
+
+// Поля города из JSON. Город собирается, когда прочитана вся страна:
+// в объекте страны "cities" может стоять раньше ее кода или часового пояса
+struct CityFields {
+    std::string name;
+    std::string iso_code;
+    std::string phone_code;
+};
+
+void ReadCityList(JsonReader& reader, std::vector<CityFields>& city_fields) {
+    reader.ReadArray([&] {
+        CityFields& fields = city_fields.emplace_back();
+        reader.ReadObject([&](std::string_view key) {
+            if (key == "name"sv) {
+                fields.name = reader.ReadString();
+            }
+            else if (key == "iso_code"sv) {
+                fields.iso_code = reader.ReadString();
+            }
+            else if (key == "phone_code"sv) {
+                fields.phone_code = reader.ReadString();
+            }
+            else {
+                reader.SkipValue();
+            }
+        });
+    });
+}
+
+// Город страны country, которая лежит в векторе стран под номером country_index: полный City или CompactCity
+template <typename CityType>
+CityType BuildCity(CityFields&& fields, const Country& country, size_t country_index) {
+    if constexpr (std::is_same_v<CityType, CompactCity>) {
+        return MakeCompactCity(std::move(fields.name), std::move(fields.iso_code),
+                               country.phone_code, fields.phone_code, country_index);
+    }
+    else {
+        return CityBuilder()
+            .SetName(fields.name)
+            .SetIsoCode(fields.iso_code)
+            .SetPhoneCode(country.phone_code, fields.phone_code)
+            .SetCountryName(country.name)
+            .SetCountryIsoCode(country.iso_code)
+            .SetTimeZone(country.time_zone)
+            .SetLanguage(country.languages)
+            .Build();
+    }
+}
+
+// Чтение одного объекта страны. Поля городов добавляются в city_fields
+void ReadCountry(JsonReader& reader, Country& country, std::vector<CityFields>& city_fields) {
+    reader.ReadObject([&](std::string_view key) {
+        if (key == "name"sv) {
+            country.name = reader.ReadString();
+        }
+        else if (key == "iso_code"sv) {
+            country.iso_code = reader.ReadString();
+        }
+        else if (key == "phone_code"sv) {
+            country.phone_code = reader.ReadString();
+        }
+        else if (key == "time_zone"sv) {
+            country.time_zone = reader.ReadString();
+        }
+        else if (key == "languages"sv) {
+            reader.ReadArray([&] {
+                country.languages.push_back(FromString<Language>(std::string(reader.ReadString())));
+            });
+        }
+        else if (key == "cities"sv) {
+            ReadCityList(reader, city_fields);
+        }
+        else {
+            reader.SkipValue();
+        }
+    });
+}
+
+// Результат совпадает с ParseCountryJson по дереву. Отсутствующие поля остаются пустыми.
+// Если задан file, прочитанные страницы отдаются системе после каждой страны
+template <typename CityType>
+void ReadCountryList(JsonReader& reader, vector<Country>& countries, vector<CityType>& cities, MappedFile* file) {
+    std::vector<CityFields> city_fields; // Буфер переиспользуется между странами
+    reader.ReadArray([&] {
+        Country country;
+        city_fields.clear();
+        ReadCountry(reader, country, city_fields);
+
+        // Добавляем страну, затем ее города, как ParseCountryJson
+        countries.push_back(std::move(country));
+        for (CityFields& fields : city_fields) {
+            cities.push_back(BuildCity<CityType>(std::move(fields), countries.back(), countries.size() - 1));
+        }
+
+        if (file != nullptr) {
+            file->Release(reader.Position());
+        }
+    });
+    reader.ExpectEnd();
+}
+
+// Потоковый вариант ParseCountryJson по тексту документа. Города - City или CompactCity
+template <typename CityType>
+void ParseCountryJson(vector<Country>& countries, vector<CityType>& cities, std::string_view json_text) {
+    JsonReader reader(json_text);
+    ReadCountryList(reader, countries, cities, nullptr);
+}
+
+// Потоковый вариант ParseCountryJson по файлу, который отображается в память
+template <typename CityType>
+void ParseCountryJsonFile(vector<Country>& countries, vector<CityType>& cities, const std::string& path) {
+    MappedFile file(path);
+    JsonReader reader(file.Data());
+    ReadCountryList(reader, countries, cities, &file);
+}
+
+//------------------------------------------------------------------------------------------
+// Параллельный разбор: страны независимы и разбираются в разных потоках. Один быстрый проход
+// находит границы стран, только перескакивая строки и считая скобки, а проверка синтаксиса
+// и разбор полей целиком достаются потокам. Города каждой страны собираются отдельно
+// и переносятся в результат по порядку стран, поэтому порядок тот же, что у последовательного разбора
+
+// Выполняет task(i) для всех i из order. Потоки забирают следующую задачу из общего счетчика,
+// так что поток с мелкими задачами не простаивает, пока другой разбирает крупную.
+// Исключения задач собираются, а после завершения всех задач выбрасывается исключение
+// задачи с наименьшим номером
+template <typename Task>
+void RunCountryTasks(const std::vector<size_t>& order, unsigned threads_amount, Task&& task) {
+    std::atomic<size_t> next_task = 0;
+    std::mutex error_mutex;
+    size_t error_index = SIZE_MAX;
+    std::exception_ptr error;
+
+    const auto worker = [&] {
+        for (size_t k = next_task++; k < order.size(); k = next_task++) {
+            try {
+                task(order[k]);
+            }
+            catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (order[k] < error_index) {
+                    error_index = order[k];
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    // Текущий поток тоже работает, дополнительных потоков не больше, чем задач
+    const size_t extra_threads = std::min<size_t>(std::max(threads_amount, 1u) - 1, order.size() > 0 ? order.size() - 1 : 0);
+    std::vector<std::jthread> threads;
+    threads.reserve(extra_threads);
+    for (size_t i = 0; i < extra_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    threads.clear();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Границы элементов массива верхнего уровня: от символа после '[' или ',' до следующей ',' или ']'
+// той же глубины. Проход не проверяет синтаксис: строки только перескакиваются до закрывающей
+// кавычки, а у скобок считается лишь глубина. Содержимое элементов, включая пустые элементы
+// и непарные скобки внутри них, проверяет разбор каждой страны. Если границы найти не удалось,
+// выбрасывается JsonSyntaxError, но точную ошибку дает только последовательное чтение
+std::vector<std::pair<size_t, size_t>> FindCountryRanges(std::string_view json_text) {
+    const auto fail = [](size_t offset) {
+        throw JsonSyntaxError("Unbalanced country list"s, offset);
+    };
+    const auto is_space = [](char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    };
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t pos = json_text.find_first_not_of(" \n\r\t"sv);
+    if (pos == std::string_view::npos || json_text[pos] != '[') {
+        fail(pos == std::string_view::npos ? json_text.size() : pos);
+    }
+    size_t begin = ++pos;
+    size_t depth = 0; // Глубина внутри текущего элемента
+    bool empty_list = true;
+    for (; pos < json_text.size(); ++pos) {
+        const char c = json_text[pos];
+        if (c == '"') {
+            // Строки занимают большую часть документа, поэтому закрывающая кавычка ищется через find
+            // (memchr), а не посимвольно. Кавычка экранирована, если перед ней нечетное число '\\'
+            while (true) {
+                pos = json_text.find('"', pos + 1);
+                if (pos == std::string_view::npos) {
+                    fail(json_text.size());
+                }
+                size_t backslashes = 0;
+                while (json_text[pos - 1 - backslashes] == '\\') {
+                    ++backslashes;
+                }
+                if (backslashes % 2 == 0) {
+                    break;
+                }
+            }
+            empty_list = false;
+        }
+        else if (c == '[' || c == '{') {
+            ++depth;
+            empty_list = false;
+        }
+        else if (depth > 0 && (c == ']' || c == '}')) {
+            --depth;
+        }
+        else if (depth == 0 && (c == ',' || c == ']')) {
+            // "[ ]" - пустой список, а не один пустой элемент
+            if (c == ',' || !empty_list) {
+                ranges.emplace_back(begin, pos);
+            }
+            begin = pos + 1;
+            if (c == ']') {
+                break;
+            }
+        }
+        else if (!is_space(c)) {
+            empty_list = false;
+        }
+    }
+    if (pos >= json_text.size()) {
+        fail(json_text.size());
+    }
+    // После списка - только пробельные символы
+    if (json_text.find_first_not_of(" \n\r\t"sv, pos + 1) != std::string_view::npos) {
+        fail(pos + 1);
+    }
+    return ranges;
+}
+
+// Читает документ так же, как последовательный разбор, но ничего не сохраняет.
+// Бросает то же исключение, что и ParseCountryJson на этом документе
+void ValidateCountryJson(std::string_view json_text) {
+    JsonReader reader(json_text);
+    std::vector<CityFields> city_fields;
+    reader.ReadArray([&] {
+        Country country;
+        city_fields.clear();
+        ReadCountry(reader, country, city_fields);
+    });
+    reader.ExpectEnd();
+}
+
+// Разбор для ParseCountryJsonParallel. При ошибке countries может остаться с лишними странами,
+// а cities не меняется: города переносятся в него только после разбора всех стран
+template <typename CityType>
+void ParseCountries(vector<Country>& countries, vector<CityType>& cities, std::string_view json_text,
+                    unsigned threads_amount) {
+    const std::vector<std::pair<size_t, size_t>> ranges = FindCountryRanges(json_text);
+
+    // Крупные страны первыми: иначе самая большая может достаться потоку последней
+    std::vector<size_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&ranges](size_t lhs, size_t rhs) {
+        return ranges[lhs].second - ranges[lhs].first > ranges[rhs].second - ranges[rhs].first;
+    });
+
+    // Города каждой страны собираются в отдельный вектор ровно нужного размера
+    const size_t first_country = countries.size();
+    countries.resize(first_country + ranges.size());
+    std::vector<std::vector<CityType>> country_cities(ranges.size());
+    RunCountryTasks(order, threads_amount, [&](size_t i) {
+        JsonReader country_reader(json_text, ranges[i].first, ranges[i].second);
+        Country& country = countries[first_country + i];
+        std::vector<CityFields> city_fields;
+        ReadCountry(country_reader, country, city_fields);
+        country_reader.ExpectEnd();
+        std::vector<CityType>& result = country_cities[i];
+        result.reserve(city_fields.size());
+        for (CityFields& fields : city_fields) {
+            result.push_back(BuildCity<CityType>(std::move(fields), country, first_country + i));
+        }
+    });
+
+    size_t city_amount = 0;
+    for (const std::vector<CityType>& result : country_cities) {
+        city_amount += result.size();
+    }
+    cities.reserve(cities.size() + city_amount);
+    for (std::vector<CityType>& result : country_cities) {
+        cities.insert(cities.end(), std::make_move_iterator(result.begin()), std::make_move_iterator(result.end()));
+        // Память под города страны освобождается сразу, а не после переноса всех стран
+        std::vector<CityType>().swap(result);
+    }
+}
+
+// Параллельный вариант ParseCountryJson по тексту документа: результат тот же, включая порядок.
+// При ошибке векторы остаются как были, а исключение - то же, что у ParseCountryJson
+template <typename CityType>
+void ParseCountryJsonParallel(vector<Country>& countries, vector<CityType>& cities, std::string_view json_text,
+                              unsigned threads_amount = std::thread::hardware_concurrency()) {
+    const size_t first_country = countries.size();
+    try {
+        ParseCountries(countries, cities, json_text, threads_amount);
+    }
+    catch (...) {
+        countries.resize(first_country);
+        // Ошибки находятся не в том порядке, что у последовательного разбора: границы стран ищутся
+        // раньше разбора, а страны разбираются вразнобой. Чтобы ошибка совпала,
+        // документ читается заново последовательно до первой ошибки. Это нужно только при ошибке
+        ValidateCountryJson(json_text);
+        throw;
+    }
+}
+
+// Параллельный вариант ParseCountryJsonFile. В отличие от него не отдает прочитанные страницы
+// системе (Release): страны разбираются вразнобой, поэтому весь файл остается отображенным
+// и занимает память до конца разбора, как документ в строке
+template <typename CityType>
+void ParseCountryJsonFileParallel(vector<Country>& countries, vector<CityType>& cities, const std::string& path,
+                                  unsigned threads_amount = std::thread::hardware_concurrency()) {
+    MappedFile file(path);
+    ParseCountryJsonParallel(countries, cities, file.Data(), threads_amount);
+}
+
+//------------------------------------------------------------------------------------------
+// Тесты потокового разбора
+
+#include <cassert>
+#include <fstream>
+
+namespace tests {
+
+    // Поля в произвольном порядке, escape-последовательности и лишние поля любых типов
+    const std::string_view COUNTRIES_JSON = R"([
+        {
+            "cities": [
+                {"name": "São \"Paulo\"", "iso_code": "BR-SP", "phone_code": "11", "population": 12.3e6},
+                {"phone_code": "21", "name": "Rio\t🌴", "iso_code": "BR-RJ", "tags": ["beach", {"a": [1, "]"]}]}
+            ],
+            "name": "Brazil",
+            "iso_code": "BR",
+            "extra": {"nested": [true, false, null, "}\\", -0.5, 0, 7E+2, 1e-3, [], {}], "empty": {}},
+            "phone_code": "+55",
+            "time_zone": "UTC-3",
+            "languages": ["pt"]
+        },
+        {"name": "Nowhere", "iso_code": "NW", "phone_code": "+0", "time_zone": "UTC", "languages": [], "cities": []}
+    ])";
+
+    void CheckCountries(const vector<Country>& countries, const vector<City>& cities) {
+        assert(countries.size() == 2);
+        assert(countries[0].name == "Brazil"s && countries[0].phone_code == "+55"s && countries[0].time_zone == "UTC-3"s);
+        assert(countries[0].languages.size() == 1 && countries[1].languages.empty());
+        assert(countries[1].iso_code == "NW"s);
+
+        assert(cities.size() == 2);
+        assert(cities[0].name == "S\xC3\xA3o \"Paulo\""s);
+        assert(cities[0].iso_code == "BR-SP"s && cities[0].phone_code == "+5511"s);
+        assert(cities[0].country_name == "Brazil"s && cities[0].country_iso_code == "BR"s);
+        assert(cities[0].time_zone == "UTC-3"s && cities[0].languages == countries[0].languages);
+        assert(cities[1].name == "Rio\t\xF0\x9F\x8C\xB4"s && cities[1].phone_code == "+5521"s);
+    }
+
+    void TestParseCountryJson() {
+        vector<Country> countries;
+        vector<City> cities;
+        ParseCountryJson(countries, cities, COUNTRIES_JSON);
+        CheckCountries(countries, cities);
+    }
+
+    void TestParseCountryJsonFile() {
+        const TempFile temp_file("countries_test_"sv);
+        std::ofstream(temp_file.Path()) << COUNTRIES_JSON;
+        vector<Country> countries;
+        vector<City> cities;
+        ParseCountryJsonFile(countries, cities, temp_file.Path());
+        CheckCountries(countries, cities);
+    }
+
+    void TestJsonSyntaxErrors() {
+        for (const std::string_view json : {
+                 R"([{"name": }])"sv,
+                 R"([{"name": "Brazil"})"sv,
+                 R"([{"name": "Brazil"}] [])"sv,
+                 R"([{"name": "\ud800"}])"sv,
+                 R"([{"name": "\q"}])"sv,
+                 R"([{"name": 5}])"sv,
+                 R"([{name: "Brazil"}])"sv,
+                 R"([{"extra": "unterminated}])"sv,
+                 // Ошибки внутри пропускаемых значений
+                 R"([{"extra": [1}}])"sv,
+                 R"([{"extra": {"a": 1]}])"sv,
+                 R"([{"extra": [1 2]}])"sv,
+                 R"([{"extra": [1,]}])"sv,
+                 R"([{"extra": {"a" 1}}])"sv,
+                 R"([{"extra": {"a": 1,}}])"sv,
+                 R"([{"extra": {1: 2}}])"sv,
+                 R"([{"extra": tru}])"sv,
+                 R"([{"extra": truex}])"sv,
+                 R"([{"extra": nul}])"sv,
+                 R"([{"extra": 01}])"sv,
+                 R"([{"extra": 1.}])"sv,
+                 R"([{"extra": -}])"sv,
+                 R"([{"extra": 1e}])"sv,
+                 R"([{"extra": +1}])"sv,
+                 R"([{"extra": [[[[}])"sv,
+                 R"([{"extra": "\x"}])"sv,
+             }) {
+            vector<Country> countries;
+            vector<City> cities;
+            bool thrown = false;
+            try {
+                ParseCountryJson(countries, cities, json);
+            }
+            catch (const JsonSyntaxError&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+    }
+
+    void TestCompactCities() {
+        vector<Country> countries;
+        vector<City> cities;
+        ParseCountryJson(countries, cities, COUNTRIES_JSON);
+
+        vector<Country> compact_countries;
+        vector<CompactCity> compact_cities;
+        ParseCountryJson(compact_countries, compact_cities, COUNTRIES_JSON);
+        assert(compact_cities.size() == cities.size());
+        assert(compact_cities[1].country_index == 0 && compact_cities[1].phone_code == "+5521"s);
+        for (size_t i = 0; i < cities.size(); ++i) {
+            const City city = ExpandCity(compact_cities[i], compact_countries);
+            assert(city.name == cities[i].name && city.iso_code == cities[i].iso_code && city.phone_code == cities[i].phone_code);
+            assert(city.country_name == cities[i].country_name && city.country_iso_code == cities[i].country_iso_code);
+            assert(city.time_zone == cities[i].time_zone && city.languages == cities[i].languages);
+        }
+    }
+
+    bool SameCity(const City& lhs, const City& rhs) {
+        return lhs.name == rhs.name && lhs.iso_code == rhs.iso_code && lhs.phone_code == rhs.phone_code
+            && lhs.country_name == rhs.country_name && lhs.country_iso_code == rhs.country_iso_code
+            && lhs.time_zone == rhs.time_zone && lhs.languages == rhs.languages;
+    }
+
+    bool SameCity(const CompactCity& lhs, const CompactCity& rhs) {
+        return lhs.name == rhs.name && lhs.iso_code == rhs.iso_code && lhs.phone_code == rhs.phone_code
+            && lhs.country_index == rhs.country_index;
+    }
+
+    // Параллельный разбор дописывает в непустые векторы то же, что и последовательный
+    template <typename CityType>
+    void CheckParallelMatchesSequential(std::string_view json, unsigned threads_amount) {
+        vector<Country> countries(1);
+        vector<CityType> cities(1);
+        ParseCountryJson(countries, cities, json);
+
+        vector<Country> parallel_countries(1);
+        vector<CityType> parallel_cities(1);
+        ParseCountryJsonParallel(parallel_countries, parallel_cities, json, threads_amount);
+
+        assert(parallel_countries.size() == countries.size() && parallel_cities.size() == cities.size());
+        for (size_t i = 0; i < countries.size(); ++i) {
+            assert(parallel_countries[i].name == countries[i].name && parallel_countries[i].phone_code == countries[i].phone_code);
+            assert(parallel_countries[i].languages == countries[i].languages);
+        }
+        for (size_t i = 0; i < cities.size(); ++i) {
+            assert(SameCity(parallel_cities[i], cities[i]));
+        }
+    }
+
+    // Сообщение об ошибке разбора: последовательного при threads_amount == 0, иначе параллельного
+    template <typename CityType>
+    std::string ParseError(std::string_view json, unsigned threads_amount) {
+        vector<Country> countries;
+        vector<CityType> cities;
+        try {
+            if (threads_amount == 0) {
+                ParseCountryJson(countries, cities, json);
+            }
+            else {
+                ParseCountryJsonParallel(countries, cities, json, threads_amount);
+            }
+        }
+        catch (const JsonSyntaxError& error) {
+            return error.what();
+        }
+        return {};
+    }
+
+    void TestParseCountryJsonParallel() {
+        // Страны разного размера, пустые и с двумя списками городов
+        std::string json = "["s;
+        for (int c = 0; c < 40; ++c) {
+            json += c == 0 ? "{"s : ",{"s;
+            json += R"("name": "Country )"s + std::to_string(c) + R"(", "phone_code": "+)"s + std::to_string(c) + R"(", "cities": [)"s;
+            for (int i = 0; i < (c * 37) % 50; ++i) {
+                json += i == 0 ? ""s : ","s;
+                json += R"({"name": "City )"s + std::to_string(c) + "-"s + std::to_string(i) + R"(", "phone_code": ")"s + std::to_string(i) + R"("})"s;
+            }
+            json += c % 7 == 0 ? R"(], "cities": [{"name": "Extra"}]})"s : "]}"s;
+        }
+        json += "]"s;
+
+        for (unsigned threads_amount = 1; threads_amount <= 4; ++threads_amount) {
+            CheckParallelMatchesSequential<City>(COUNTRIES_JSON, threads_amount);
+            CheckParallelMatchesSequential<City>(json, threads_amount);
+            CheckParallelMatchesSequential<CompactCity>(json, threads_amount);
+            CheckParallelMatchesSequential<CompactCity>("[]"sv, threads_amount);
+            CheckParallelMatchesSequential<City>(" [ ] "sv, threads_amount);
+            // Скобки, запятые и экранированные кавычки внутри строк не сбивают поиск границ стран
+            CheckParallelMatchesSequential<City>(R"([{"name": "A],{\"[", "cities": [{"name": "}\\"}]}, {"name": ","}])"sv,
+                                                 threads_amount);
+        }
+
+        // Ошибка в одной из стран: исключение, а векторы остаются как были
+        vector<Country> countries(1);
+        vector<City> cities(2);
+        bool thrown = false;
+        try {
+            ParseCountryJsonParallel(countries, cities, R"([{"name": "A"}, {"name": "B", "cities": [{"name": 1}]}])"sv, 2);
+        }
+        catch (const JsonSyntaxError&) {
+            thrown = true;
+        }
+        assert(thrown && countries.size() == 1 && cities.size() == 2);
+
+        // Ошибки, которые разные фазы параллельного разбора находят раньше, чем последовательный
+        for (const std::string_view json : {
+                 // Подсчет городов спотыкается о вторую страну, а последовательный разбор - о первую
+                 R"([{"name": 1}, {"name": "B", "cities": 5}])"sv,
+                 // Поиск границ стран спотыкается о синтаксис второй страны
+                 R"([{"name": 1}, {"name": "B", "cities": [}])"sv,
+                 R"([{"cities": [{"name": 1}]}, {"name": "B", "cities": 5}, {"name": "C"])"sv,
+                 // Внутри одной страны ошибка поля стоит раньше синтаксической
+                 R"([{"name": 1, "extra": [1}]}])"sv,
+                 // Поиск границ стран не проверяет синтаксис: пустые элементы, лишние скобки,
+                 // незакрытые строки и текст после списка находит разбор
+                 R"([{"name": "A"},])"sv,
+                 R"([,{"name": "A"}])"sv,
+                 R"([{"name": "A"} {"name": "B"}])"sv,
+                 R"([{"name": "A"}}, {"name": "B"}])"sv,
+                 R"([{"name": "A"}, {"name": "B)"sv,
+                 R"([{"name": "A"}, {"name": 1})"sv,
+                 R"([{"name": "A"}] x)"sv,
+                 R"( {"name": "A"})"sv,
+                 R"([1, {"name": 1}])"sv,
+             }) {
+            for (unsigned threads_amount = 1; threads_amount <= 4; ++threads_amount) {
+                assert(ParseError<City>(json, 0) == ParseError<City>(json, threads_amount));
+                assert(ParseError<CompactCity>(json, 0) == ParseError<CompactCity>(json, threads_amount));
+            }
+        }
+        assert(ParseError<City>(R"([{"name": 1}, {"name": "B", "cities": 5}])"sv, 0) == "Expected string at offset 10"s);
+    }
+
+    void TestAll() {
+        TestParseCountryJson();
+        TestParseCountryJsonFile();
+        TestCompactCities();
+        TestParseCountryJsonParallel();
+        TestJsonSyntaxErrors();
+    }
+
+}//!namespace tests
+
+#include "HeapStats.h"
+
+namespace bench {
+
+    // Документ из нескольких больших стран с длинными названиями и часовыми поясами
+    std::string MakeLargeCountryJson(size_t countries, size_t cities_per_country) {
+        std::string json = "["s;
+        for (size_t c = 0; c < countries; ++c) {
+            json += c == 0 ? ""s : ","s;
+            json += R"({"name": "United Federation of Country )"s + std::to_string(c)
+                + R"(", "iso_code": "C)"s + std::to_string(c)
+                + R"(", "phone_code": "+)"s + std::to_string(100 + c)
+                + R"(", "time_zone": "Continent/Very_Long_City_Name", "languages": ["en", "fr", "de", "es"], "cities": [)"s;
+            for (size_t i = 0; i < cities_per_country; ++i) {
+                json += i == 0 ? ""s : ","s;
+                json += R"({"name": "City )"s + std::to_string(i) + R"(", "iso_code": "C)"s + std::to_string(i)
+                    + R"(", "phone_code": ")"s + std::to_string(i % 1000) + R"("})"s;
+            }
+            json += "]}"s;
+        }
+        json += "]"s;
+        return json;
+    }
+
+    // Полные City против CompactCity на одном документе: время разбора, число выделений
+    // и куча, которую занимает результат (страны и города), по счетчикам heap_stats.
+    // Счетчики ведет HeapStats.cpp, его надо собрать вместе с программой замеров
+    void CompactVsFullCities(std::ostream& out, size_t countries = 4, size_t cities_per_country = 250'000) {
+        const std::string json = MakeLargeCountryJson(countries, cities_per_country);
+        out << "cities\tparse_ms\tallocations\theap_mb\n"s;
+        const auto measure = [&json, &out](std::string_view name, auto cities) {
+            vector<Country> parsed_countries;
+            const size_t allocations_before = heap_stats::Allocations();
+            const size_t bytes_before = heap_stats::BytesInUse();
+            const auto start = std::chrono::steady_clock::now();
+            ParseCountryJson(parsed_countries, cities, json);
+            const double parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            out << name << '\t' << parse_ms << '\t' << heap_stats::Allocations() - allocations_before
+                << '\t' << (heap_stats::BytesInUse() - bytes_before) / 1e6 << '\n';
+        };
+        measure("City"sv, vector<City>());
+        measure("CompactCity"sv, vector<CompactCity>());
+    }
+
+    // Параллельный разбор от одного потока до числа ядер (но не меньше 4) против последовательного.
+    // scan_ms - поиск границ стран, он идет в одном потоке и ограничивает ускорение на многих ядрах
+    void ParallelScaling(std::ostream& out, size_t countries = 64, size_t cities_per_country = 20'000) {
+        const std::string json = MakeLargeCountryJson(countries, cities_per_country);
+        const auto scan_start = std::chrono::steady_clock::now();
+        const size_t ranges_amount = FindCountryRanges(json).size();
+        out << "scan_ms\t"s << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scan_start).count()
+            << "\tcountries\t"s << ranges_amount << '\n';
+        const auto measure = [&json](auto&& parse) {
+            vector<Country> parsed_countries;
+            vector<City> cities;
+            const auto start = std::chrono::steady_clock::now();
+            parse(parsed_countries, cities);
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        const double sequential_ms = measure([&json](vector<Country>& parsed_countries, vector<City>& cities) {
+            ParseCountryJson(parsed_countries, cities, json);
+        });
+        out << "threads\tparse_ms\tspeedup\n"s;
+        out << "seq\t"s << sequential_ms << "\t1\n"s;
+        const unsigned max_threads = std::max(std::thread::hardware_concurrency(), 4u);
+        for (unsigned threads_amount = 1; threads_amount <= max_threads; threads_amount *= 2) {
+            const double parallel_ms = measure([&json, threads_amount](vector<Country>& parsed_countries, vector<City>& cities) {
+                ParseCountryJsonParallel(parsed_countries, cities, json, threads_amount);
+            });
+            out << threads_amount << '\t' << parallel_ms << '\t' << sequential_ms / parallel_ms << '\n';
+        }
+    }
+
+}//!namespace bench
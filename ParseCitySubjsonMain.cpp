@@ -0,0 +1,193 @@
+// Запуск тестов и замеров ParseCitySubjson.cpp. Сам ParseCitySubjson.cpp - фрагмент программы:
+// Json, Language, FromString и City приходят из остального проекта. Здесь они заменены
+// минимальными заглушками с тем же интерфейсом, а все остальное - код из ParseCitySubjson.cpp как есть.
+// Сборка: g++ -std=c++20 -O2 ParseCitySubjsonMain.cpp HeapStats.cpp -pthread
+// HeapStats.cpp заменяет operator new ради счетчиков в замерах, тесты работают и без него
+// Без ключей выполняются тесты, с ключом --bench после них еще и замеры
+
+#include <cassert>
+#include <iostream>
+#include <list>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+//------------------------------------------------------
+//-------------------Project stand-ins------------------
+//------------------------------------------------------
+
+enum class Language {
+    EN,
+    PT,
+    RU
+};
+
+template <typename T>
+T FromString(const std::string& text);
+
+template <>
+Language FromString<Language>(const std::string& text) {
+    if (text == "pt") {
+        return Language::PT;
+    }
+    if (text == "ru") {
+        return Language::RU;
+    }
+    return Language::EN;
+}
+
+struct City {
+    std::string name;
+    std::string iso_code;
+    std::string phone_code;
+    std::string country_name;
+    std::string country_iso_code;
+    std::string time_zone;
+    std::vector<Language> languages;
+
+    bool operator==(const City&) const = default;
+};
+
+// Готовое дерево JSON: строка, список или объект. Числа и прочие значения здесь не нужны.
+// Конструкторы explicit, иначе строка с текстом JSON неявно превращалась бы в Json-строку
+// и ParseCountryJson(..., std::string) выбирал бы перегрузку для дерева
+class Json {
+public:
+    explicit Json(std::string value)
+        : value_(std::move(value)) {
+    }
+    explicit Json(std::list<Json> value)
+        : value_(std::move(value)) {
+    }
+    explicit Json(std::map<std::string, Json> value)
+        : value_(std::move(value)) {
+    }
+
+    const std::string& AsString() const {
+        return std::get<std::string>(value_);
+    }
+    const std::list<Json>& AsList() const {
+        return std::get<std::list<Json>>(value_);
+    }
+    const Json& AsObject() const {
+        std::get<std::map<std::string, Json>>(value_);
+        return *this;
+    }
+    const Json& operator[](const std::string& key) const {
+        return std::get<std::map<std::string, Json>>(value_).at(key);
+    }
+
+private:
+    std::variant<std::string, std::list<Json>, std::map<std::string, Json>> value_;
+};
+
+#include "ParseCitySubjson.cpp"
+
+namespace tests {
+
+    bool SameCountry(const Country& lhs, const Country& rhs) {
+        return lhs.name == rhs.name && lhs.iso_code == rhs.iso_code && lhs.phone_code == rhs.phone_code
+            && lhs.time_zone == rhs.time_zone && lhs.languages == rhs.languages;
+    }
+
+    // Строка JSON и ее значение: буквы, кавычки и обратные косые черты
+    std::pair<std::string, std::string> RandomJsonString(std::mt19937& generator) {
+        std::string text = "\""s;
+        std::string value;
+        for (int i = generator() % 8; i > 0; --i) {
+            const unsigned c = generator() % 30;
+            if (c == 0) {
+                text += "\\\""s;
+                value += '"';
+            }
+            else if (c == 1) {
+                text += "\\\\"s;
+                value += '\\';
+            }
+            else {
+                text += static_cast<char>('a' + c % 26);
+                value += static_cast<char>('a' + c % 26);
+            }
+        }
+        return { text + '"', value };
+    }
+
+    // Потоковый разбор текста и разбор готового дерева дают одно и то же.
+    // Текст и дерево строятся из одних и тех же случайных данных; в тексте поля идут
+    // в случайном порядке и перемежаются лишними полями, которые разбор пропускает
+    void TestStreamingMatchesDom() {
+        std::mt19937 generator(3);
+        std::string text = "["s;
+        std::list<Json> dom_countries;
+        for (int c = 0; c < 300; ++c) {
+            std::vector<std::string> fields;
+            std::map<std::string, Json> country;
+            for (const std::string& key : { "name"s, "iso_code"s, "phone_code"s, "time_zone"s }) {
+                auto [field_text, value] = RandomJsonString(generator);
+                fields.push_back('"' + key + "\": "s + field_text);
+                country.emplace(key, Json(std::move(value)));
+            }
+            fields.push_back(R"("languages": ["pt", "ru"])"s);
+            country.emplace("languages"s, Json(std::list<Json>{ Json("pt"s), Json("ru"s) }));
+            fields.push_back(R"("junk": {"x": [1, 2, {"y": null}]})"s);
+
+            std::string cities_text = R"("cities": [)"s;
+            std::list<Json> cities;
+            for (int i = generator() % 5; i > 0; --i) {
+                std::map<std::string, Json> city;
+                cities_text += cities.empty() ? "{"s : ", {"s;
+                for (const std::string& key : { "name"s, "iso_code"s, "phone_code"s }) {
+                    auto [field_text, value] = RandomJsonString(generator);
+                    cities_text += '"' + key + "\": "s + field_text + (key == "name"s ? R"(, "zz": 12, )"s : ", "s);
+                    city.emplace(key, Json(std::move(value)));
+                }
+                cities_text.resize(cities_text.size() - 2);
+                cities_text += "}"s;
+                cities.emplace_back(std::move(city));
+            }
+            fields.push_back(cities_text + "]"s);
+            country.emplace("cities"s, Json(std::move(cities)));
+            std::shuffle(fields.begin(), fields.end(), generator);
+
+            text += c == 0 ? "{"s : ",{"s;
+            for (size_t i = 0; i < fields.size(); ++i) {
+                text += (i == 0 ? ""s : ",\n "s) + fields[i];
+            }
+            text += "}"s;
+            dom_countries.emplace_back(std::move(country));
+        }
+        text += "]"s;
+        const Json dom(std::move(dom_countries));
+
+        std::vector<Country> dom_parsed_countries;
+        std::vector<City> dom_cities;
+        ParseCountryJson(dom_parsed_countries, dom_cities, dom);
+        std::vector<Country> countries;
+        std::vector<City> cities;
+        ParseCountryJson(countries, cities, std::string_view(text));
+        assert(!cities.empty() && cities == dom_cities);
+        assert(std::equal(countries.begin(), countries.end(), dom_parsed_countries.begin(), dom_parsed_countries.end(), SameCountry));
+
+        std::vector<Country> compact_countries;
+        std::vector<CompactCity> compact_cities;
+        ParseCountryJson(compact_countries, compact_cities, dom);
+        assert(compact_cities.size() == cities.size());
+        for (size_t i = 0; i < compact_cities.size(); ++i) {
+            assert(ExpandCity(compact_cities[i], compact_countries) == cities[i]);
+        }
+    }
+
+}//!namespace tests
+
+int main(int argc, char* argv[]) {
+    tests::TestAll();
+    tests::TestStreamingMatchesDom();
+    if (argc > 1 && argv[1] == "--bench"sv) {
+        bench::CompactVsFullCities(std::cout);
+        bench::ParallelScaling(std::cout);
+    }
+    return 0;
+}
@@ -1,71 +1,288 @@
+#include <algorithm> //std::max
+#include <atomic>
+#include <charconv> //std::from_chars, std::to_chars
+#include <cstdint>
+#include <cstring> //std::memmove
 #include <iomanip> //std::setprecision
 #include <iostream>
-#include <numeric> //std::accumulate
+#include <memory> //std::shared_ptr
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility> //std::as_const, std::pair
 #include <vector>
 
-class Book {
+//Дерево Фенвика: прибавление к элементу и сумма на префиксе за O(log N)
+class FenwickTree {
+public:
+    explicit FenwickTree(size_t size);
+    void Add(size_t pos, int delta);
+    int PrefixSum(size_t end) const; //Сумма элементов на полуинтервале [0, end)
+    std::vector<int> PrefixSums() const; //Все суммы на префиксах сразу за O(N): результат[i] == PrefixSum(i)
+private:
+    std::vector<int> tree_;
+};
+
+//Индекс читателей на открытой адресации. Подходит для разреженных айди из всего диапазона int.
+//Ключ - айди читателя, значение - его текущая страница. Все записи лежат в одном массиве
+class FlatReaderIndex {
+public:
+    FlatReaderIndex();
+    //Указатель на страницу читателя или nullptr, если читателя нет
+    int* Find(int reader_id);
+    const int* Find(int reader_id) const;
+    //Добавляет читателя, если его еще нет. Возвращает указатель на его страницу и признак вставки
+    std::pair<int*, bool> Emplace(int reader_id, int page_num);
+private:
+    struct Slot {
+        int reader_id = 0;
+        int page_num = EMPTY; //Страницы неотрицательны, поэтому EMPTY помечает свободную ячейку
+    };
+    static constexpr int EMPTY = -1;
+
+    size_t SlotIndex(int reader_id) const;
+    void Grow();
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+    int shift_ = 0;
+};
+
+//Индекс читателей для заранее известного ограниченного диапазона айди [0, max_reader_id].
+//Страница читателя лежит прямо по его айди, поиск - одно обращение к массиву
+class DirectReaderIndex {
 public:
-    Book(size_t);
+    explicit DirectReaderIndex(int max_reader_id);
+    int* Find(int reader_id);
+    const int* Find(int reader_id) const;
+    std::pair<int*, bool> Emplace(int reader_id, int page_num);
+private:
+    static constexpr int EMPTY = -1;
+
+    std::vector<int> pages_;
+};
+
+template <typename ReaderIndex>
+class BasicBookSnapshot;
+
+template <typename ReaderIndex>
+class BasicBook {
+public:
+    BasicBook(size_t pages, ReaderIndex index = ReaderIndex());
     void Read(int reader_id, int page_num);
-    double Cheer(int reader_id);
+    double Cheer(int reader_id) const;
+    BasicBookSnapshot<ReaderIndex> MakeSnapshot() const;
 private:
-    size_t MAX_PAGE_SIZE = 1000;
     int readers_amount_ = 0; //Общее кол-во читателей книги
-    std::vector<int> readers_; //Читатели книги. Тут хранится текущая страница каждого читателя.
-    std::vector<int> page_stats_; //Индекс страниц. Индексы вектора - номер страницы, значение - кол-во читателей на этой странице в данный момент
-    std::unordered_map<int, int> index_; //Индекс читателей. Ключ - айди читателя, значение - его индекс в векторе читателей
+    FenwickTree page_stats_; //Индекс страниц. Позиция - номер страницы, значение - кол-во читателей на этой странице в данный момент
+    ReaderIndex index_; //Индекс читателей. Ключ - айди читателя, значение - его текущая страница
 };
 
-Book::Book(size_t pages) {
-    page_stats_.resize(pages + 1);
+//Неизменяемая копия состояния книги на момент создания.
+//Хранит готовые суммы на префиксах страниц, поэтому Cheer по снимку выполняется за O(1)
+template <typename ReaderIndex>
+class BasicBookSnapshot {
+public:
+    BasicBookSnapshot(int readers_amount, std::vector<int> prefix_counts, ReaderIndex index);
+    double Cheer(int reader_id) const;
+private:
+    int readers_amount_ = 0;
+    std::vector<int> prefix_counts_; //prefix_counts_[i] - кол-во читателей на страницах меньше i
+    ReaderIndex index_;
+};
+
+using Book = BasicBook<FlatReaderIndex>;
+using BookSnapshot = BasicBookSnapshot<FlatReaderIndex>;
+
+FenwickTree::FenwickTree(size_t size)
+    : tree_(size + 1) {
 }
 
-void Book::Read(int reader_id, int page_num) {
-    if (!index_.count(reader_id)) {
-        //Если это новый читатель, увеличиваем общее число читателей, добавляем его в индексы
-        index_[reader_id] = readers_amount_++;
-        readers_.push_back(page_num);
+void FenwickTree::Add(size_t pos, int delta) {
+    //Внутри дерево нумеруется с единицы
+    for (size_t i = pos + 1; i < tree_.size(); i += i & (~i + 1)) {
+        tree_[i] += delta;
     }
-    else {
-        //Если не новый, то меняем текущую страницу у читателя.
-        //Если она была не нулевой(читатель первый раз взял книгу), 
-        //в индексе страниц уменьшаем старое значение на единицу
-        int& prev_page = page_stats_[readers_[index_.at(reader_id)]];
-        if (prev_page > 0) {
-            prev_page -= 1;
-        }
+}
+
+int FenwickTree::PrefixSum(size_t end) const {
+    int sum = 0;
+    for (size_t i = end; i > 0; i -= i & (~i + 1)) {
+        sum += tree_[i];
     }
-    //Прибавляем к новой текущей странице единицу
-    page_stats_[page_num] += 1;
+    return sum;
+}
 
-    //Обновляем индекс читателей
-    readers_[index_.at(reader_id)] = page_num;
+std::vector<int> FenwickTree::PrefixSums() const {
+    //Узел i хранит сумму на полуинтервале (i - lowbit(i), i], поэтому
+    //сумма на префиксе длины i складывается из уже посчитанного префикса и одного узла
+    std::vector<int> sums(tree_.size());
+    for (size_t i = 1; i < tree_.size(); ++i) {
+        sums[i] = sums[i - (i & (~i + 1))] + tree_[i];
+    }
+    return sums;
 }
 
-double Book::Cheer(int reader_id) {
-    if (index_.count(reader_id) == 0) {
+//Доля остальных читателей, прочитавших меньше страниц, чем данный читатель
+double CheerShare(int readers_before, int readers_amount) {
+    if (readers_amount == 1) {
+        return 1;
+    }
+    if (readers_before == 0) {
+        //Если никто не прочитал меньше него
         return 0;
     }
-    else if (readers_amount_ == 1) {
-        return 1;
+    return static_cast<double>(readers_before) / (readers_amount - 1);
+}
+
+FlatReaderIndex::FlatReaderIndex()
+    : slots_(16)
+    , shift_(64 - 4) {
+}
+
+size_t FlatReaderIndex::SlotIndex(int reader_id) const {
+    //Мультипликативное хеширование Фибоначчи: старшие биты произведения равномерно
+    //распределяют и подряд идущие айди, и айди с общими младшими битами
+    return static_cast<size_t>((static_cast<uint64_t>(static_cast<uint32_t>(reader_id)) * 0x9E3779B97F4A7C15ull) >> shift_);
+}
+
+int* FlatReaderIndex::Find(int reader_id) {
+    return const_cast<int*>(std::as_const(*this).Find(reader_id));
+}
+
+const int* FlatReaderIndex::Find(int reader_id) const {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = SlotIndex(reader_id);; i = (i + 1) & mask) {
+        const Slot& slot = slots_[i];
+        if (slot.page_num == EMPTY) {
+            return nullptr;
+        }
+        if (slot.reader_id == reader_id) {
+            return &slot.page_num;
+        }
     }
-    else {
-        double accum = 0;
-        //Считаем кол-во людей, прочитавших менее текущего читателя
-        //Смотрим от 0 страницы до текущей страницы (readers_[reader_id])
-        accum = std::accumulate(page_stats_.begin(), page_stats_.begin() + readers_[index_.at(reader_id)], 0.0);
-        if (accum == 0) {
-            //Если никто не прочитал меньше него
-            return 0;
+}
+
+std::pair<int*, bool> FlatReaderIndex::Emplace(int reader_id, int page_num) {
+    //Держим заполненность не выше половины, чтобы цепочки проб оставались короткими
+    if ((size_ + 1) * 2 > slots_.size()) {
+        Grow();
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = SlotIndex(reader_id);; i = (i + 1) & mask) {
+        Slot& slot = slots_[i];
+        if (slot.page_num == EMPTY) {
+            slot = { reader_id, page_num };
+            ++size_;
+            return { &slot.page_num, true };
         }
-        else {
-            return accum / (readers_amount_ - 1);
+        if (slot.reader_id == reader_id) {
+            return { &slot.page_num, false };
         }
     }
 }
 
+void FlatReaderIndex::Grow() {
+    std::vector<Slot> old_slots(slots_.size() * 2);
+    old_slots.swap(slots_);
+    --shift_;
+    size_ = 0;
+    for (const Slot& slot : old_slots) {
+        if (slot.page_num != EMPTY) {
+            Emplace(slot.reader_id, slot.page_num);
+        }
+    }
+}
+
+DirectReaderIndex::DirectReaderIndex(int max_reader_id)
+    : pages_(static_cast<size_t>(max_reader_id) + 1, EMPTY) {
+}
+
+int* DirectReaderIndex::Find(int reader_id) {
+    return const_cast<int*>(std::as_const(*this).Find(reader_id));
+}
+
+const int* DirectReaderIndex::Find(int reader_id) const {
+    if (reader_id < 0 || static_cast<size_t>(reader_id) >= pages_.size() || pages_[reader_id] == EMPTY) {
+        return nullptr;
+    }
+    return &pages_[reader_id];
+}
+
+std::pair<int*, bool> DirectReaderIndex::Emplace(int reader_id, int page_num) {
+    if (reader_id < 0 || static_cast<size_t>(reader_id) >= pages_.size()) {
+        throw std::out_of_range("Reader id is out of range.");
+    }
+    int& page = pages_[reader_id];
+    const bool inserted = page == EMPTY;
+    if (inserted) {
+        page = page_num;
+    }
+    return { &page, inserted };
+}
+
+template <typename ReaderIndex>
+BasicBook<ReaderIndex>::BasicBook(size_t pages, ReaderIndex index)
+    : page_stats_(pages + 1)
+    , index_(std::move(index)) {
+}
+
+template <typename ReaderIndex>
+void BasicBook<ReaderIndex>::Read(int reader_id, int page_num) {
+    //Один поиск в индексе: либо добавляем нового читателя, либо получаем его текущую страницу
+    const auto [page, inserted] = index_.Emplace(reader_id, page_num);
+    if (inserted) {
+        //Если это новый читатель, увеличиваем общее число читателей
+        ++readers_amount_;
+    }
+    else {
+        //Если не новый, то меняем текущую страницу у читателя.
+        //Сам читатель учтен на старой странице, поэтому ее счетчик всегда больше нуля
+        //и его можно уменьшать без проверки
+        page_stats_.Add(*page, -1);
+        *page = page_num;
+    }
+    //Прибавляем к новой текущей странице единицу
+    page_stats_.Add(page_num, 1);
+}
+
+template <typename ReaderIndex>
+double BasicBook<ReaderIndex>::Cheer(int reader_id) const {
+    const int* page = index_.Find(reader_id);
+    if (page == nullptr) {
+        return 0;
+    }
+    //Считаем кол-во людей, прочитавших менее текущего читателя
+    //Смотрим от 0 страницы до текущей страницы читателя
+    return CheerShare(page_stats_.PrefixSum(*page), readers_amount_);
+}
+
+template <typename ReaderIndex>
+BasicBookSnapshot<ReaderIndex> BasicBook<ReaderIndex>::MakeSnapshot() const {
+    return { readers_amount_, page_stats_.PrefixSums(), index_ };
+}
+
+template <typename ReaderIndex>
+BasicBookSnapshot<ReaderIndex>::BasicBookSnapshot(int readers_amount, std::vector<int> prefix_counts, ReaderIndex index)
+    : readers_amount_(readers_amount)
+    , prefix_counts_(std::move(prefix_counts))
+    , index_(std::move(index)) {
+}
+
+template <typename ReaderIndex>
+double BasicBookSnapshot<ReaderIndex>::Cheer(int reader_id) const {
+    const int* page = index_.Find(reader_id);
+    if (page == nullptr) {
+        return 0;
+    }
+    return CheerShare(prefix_counts_[*page], readers_amount_);
+}
+
 void ParseInput(Book& book, std::istream& in = std::cin, std::ostream& out = std::cout) {
     using namespace std::literals;
     out << std::setprecision(6);
@@ -90,9 +307,967 @@ void ParseInput(Book& book, std::istream& in = std::cin, std::ostream& out = std
     }
 }
 
-int main() {
+//Чтение команд большими блоками напрямую из буфера потока, без operator>> на каждый токен
+class CommandScanner {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+    explicit CommandScanner(std::istream& in, size_t block_size = BLOCK_SIZE);
+    //Возвращает очередное слово. Пустая строка - вход закончился.
+    //Ссылается на внутренний буфер и действительна до следующего чтения
+    std::string_view NextWord();
+    template <typename Number>
+    Number NextNumber();
+private:
+    //Переносит непрочитанный хвост [from, end_) в начало буфера и дочитывает блок
+    bool Refill(size_t& from);
+
+    std::streambuf* in_;
+    std::vector<char> buffer_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+};
+
+//Накапливает ответы в буфере и пишет их в поток крупными кусками
+class AnswerWriter {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+    explicit AnswerWriter(std::ostream& out, size_t block_size = BLOCK_SIZE);
+    AnswerWriter(const AnswerWriter&) = delete;
+    AnswerWriter& operator=(const AnswerWriter&) = delete;
+    ~AnswerWriter();
+
+    //Форматирует так же, как operator<< с std::setprecision(6)
+    void Write(double value);
+    void Flush();
+private:
+    //С запасом на самое длинное представление в формате %.6g и перевод строки
+    static constexpr size_t MAX_ANSWER_SIZE = 32;
+
+    std::ostream& out_;
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+};
+
+CommandScanner::CommandScanner(std::istream& in, size_t block_size)
+    : in_(in.rdbuf())
+    , buffer_(block_size) {
+}
+
+bool CommandScanner::Refill(size_t& from) {
+    const size_t tail = end_ - from;
+    std::memmove(buffer_.data(), buffer_.data() + from, tail);
+    pos_ -= from;
+    end_ = tail;
+    from = 0;
+    if (end_ == buffer_.size()) {
+        //Слово не помещается в буфер целиком
+        buffer_.resize(buffer_.size() * 2);
+    }
+    const std::streamsize read = in_->sgetn(buffer_.data() + end_, buffer_.size() - end_);
+    end_ += static_cast<size_t>(read);
+    return read > 0;
+}
+
+std::string_view CommandScanner::NextWord() {
+    //Пропускаем пробельные символы
+    size_t start = pos_;
+    for (;;) {
+        while (pos_ < end_ && static_cast<unsigned char>(buffer_[pos_]) <= ' ') {
+            ++pos_;
+        }
+        start = pos_;
+        if (pos_ < end_ || !Refill(start)) {
+            break;
+        }
+    }
+    //Читаем слово, пока не встретим пробельный символ или конец входа
+    for (;;) {
+        while (pos_ < end_ && static_cast<unsigned char>(buffer_[pos_]) > ' ') {
+            ++pos_;
+        }
+        if (pos_ < end_ || !Refill(start)) {
+            break;
+        }
+    }
+    return { buffer_.data() + start, pos_ - start };
+}
+
+template <typename Number>
+Number CommandScanner::NextNumber() {
+    const std::string_view word = NextWord();
+    Number number = 0;
+    const auto [ptr, ec] = std::from_chars(word.data(), word.data() + word.size(), number);
+    if (word.empty() || ec != std::errc() || ptr != word.data() + word.size()) {
+        throw std::logic_error("Wrong number input.");
+    }
+    return number;
+}
+
+AnswerWriter::AnswerWriter(std::ostream& out, size_t block_size)
+    : out_(out)
+    , buffer_(std::max(block_size, MAX_ANSWER_SIZE)) {
+}
+
+AnswerWriter::~AnswerWriter() {
+    //Дописываем ответы, накопленные до исключения, как это делал бы std::endl
+    Flush();
+}
+
+void AnswerWriter::Write(double value) {
+    if (buffer_.size() - size_ < MAX_ANSWER_SIZE) {
+        Flush();
+    }
+    char* begin = buffer_.data() + size_;
+    //Формат general с точностью 6 совпадает с выводом потока при std::setprecision(6)
+    char* end = std::to_chars(begin, buffer_.data() + buffer_.size(), value, std::chars_format::general, 6).ptr;
+    *end++ = '\n';
+    size_ += end - begin;
+}
+
+void AnswerWriter::Flush() {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(size_));
+    out_.flush();
+    size_ = 0;
+}
+
+//Тот же формат входа и выхода, что у ParseInput, но без накладных расходов iostream на каждый запрос
+void ParseInputBuffered(Book& book, std::istream& in = std::cin, std::ostream& out = std::cout) {
+    using namespace std::literals;
+    CommandScanner scanner(in);
+    AnswerWriter writer(out);
+    const size_t requests_amount = scanner.NextNumber<size_t>();
+    for (size_t i = 0; i < requests_amount; ++i) {
+        const std::string_view command = scanner.NextWord();
+        if (command == "CHEER"sv) {
+            writer.Write(book.Cheer(scanner.NextNumber<int>()));
+        }
+        else if (command == "READ"sv) {
+            const int reader_id = scanner.NextNumber<int>();
+            const int page_num = scanner.NextNumber<int>();
+            book.Read(reader_id, page_num);
+        }
+        else {
+            throw std::logic_error("Wrong command input.");
+        }
+    }
+    writer.Flush();
+}
+
+//------------------------------------------------------
+//-----------------------Library------------------------
+//------------------------------------------------------
+
+//Много книг, разложенных по шардам. У каждого шарда своя блокировка читатель-писатель,
+//поэтому запросы к книгам из разных шардов не мешают друг другу.
+//Помимо точного Cheer под разделяемой блокировкой есть CheerSnapshot, который читает
+//последний опубликованный снимок шарда и не ждет ни READ-запросов, ни сборки снимков:
+//READ-запросы применяются параллельно и становятся видны в снимке после Publish.
+//CheerSnapshot не lock-free: указатель на снимок он копирует под коротким snapshot_mutex
+class Library {
+public:
+    explicit Library(size_t pages, size_t shards_amount = std::max(1u, std::thread::hardware_concurrency()));
+
+    void Read(int book_id, int reader_id, int page_num);
+    double Cheer(int book_id, int reader_id) const;
+    double CheerSnapshot(int book_id, int reader_id) const;
+    //Публикует новые снимки книг, измененных с прошлой публикации.
+    //Карта снимка шарда копируется целиком, поэтому один вызов стоит O(книг в шарде)
+    //плюс O(P + R) на каждую измененную книгу, где R - размер ее индекса читателей:
+    //снимок получает собственную копию индекса. READ-запросы между вызовами копятся в changed,
+    //и эта цена платится один раз за всю пачку записей, а не за каждую
+    void Publish();
+
+private:
+    using ShardSnapshot = std::unordered_map<int, std::shared_ptr<const BookSnapshot>>;
+
+    //Выравнивание по кеш-линии, чтобы блокировки соседних шардов не делили одну линию
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<int, Book> books;
+        std::unordered_set<int> changed; //Книги, измененные после последней публикации
+        std::mutex publish_mutex; //Сериализует публикации одного шарда
+        //Под snapshot_mutex только копируется или подменяется указатель, сами снимки неизменяемы
+        mutable std::mutex snapshot_mutex;
+        std::shared_ptr<const ShardSnapshot> snapshot = std::make_shared<const ShardSnapshot>();
+    };
+
+    Shard& GetShard(int book_id);
+    const Shard& GetShard(int book_id) const;
+    static std::shared_ptr<const ShardSnapshot> LoadSnapshot(const Shard& shard);
+
+    size_t pages_;
+    std::vector<Shard> shards_;
+};
+
+Library::Library(size_t pages, size_t shards_amount)
+    : pages_(pages)
+    , shards_(std::max<size_t>(shards_amount, 1)) {
+}
+
+Library::Shard& Library::GetShard(int book_id) {
+    return shards_[static_cast<uint32_t>(book_id) % shards_.size()];
+}
+
+const Library::Shard& Library::GetShard(int book_id) const {
+    return shards_[static_cast<uint32_t>(book_id) % shards_.size()];
+}
+
+void Library::Read(int book_id, int reader_id, int page_num) {
+    Shard& shard = GetShard(book_id);
+    std::unique_lock lock(shard.mutex);
+    shard.books.try_emplace(book_id, pages_).first->second.Read(reader_id, page_num);
+    shard.changed.insert(book_id);
+}
+
+double Library::Cheer(int book_id, int reader_id) const {
+    const Shard& shard = GetShard(book_id);
+    std::shared_lock lock(shard.mutex);
+    const auto it = shard.books.find(book_id);
+    return it == shard.books.end() ? 0 : it->second.Cheer(reader_id);
+}
+
+std::shared_ptr<const Library::ShardSnapshot> Library::LoadSnapshot(const Shard& shard) {
+    std::lock_guard lock(shard.snapshot_mutex);
+    return shard.snapshot;
+}
+
+double Library::CheerSnapshot(int book_id, int reader_id) const {
+    const std::shared_ptr<const ShardSnapshot> snapshot = LoadSnapshot(GetShard(book_id));
+    const auto it = snapshot->find(book_id);
+    return it == snapshot->end() ? 0 : it->second->Cheer(reader_id);
+}
+
+void Library::Publish() {
+    for (Shard& shard : shards_) {
+        std::lock_guard publish_lock(shard.publish_mutex);
+        std::unordered_set<int> changed;
+        {
+            //Забираем список изменений целиком. Книги, измененные после этого,
+            //снова попадут в список и будут опубликованы в следующий раз
+            std::unique_lock lock(shard.mutex);
+            changed.swap(shard.changed);
+        }
+        if (changed.empty()) {
+            continue;
+        }
+        //Снимок подменяет только этот поток (под publish_mutex), поэтому копия карты
+        //собирается без блокировок шарда
+        auto snapshot = std::make_shared<ShardSnapshot>(*LoadSnapshot(shard));
+        {
+            //Копируем книги под разделяемой блокировкой: точные Cheer при этом продолжают работать
+            std::shared_lock lock(shard.mutex);
+            for (int book_id : changed) {
+                (*snapshot)[book_id] = std::make_shared<const BookSnapshot>(shard.books.at(book_id).MakeSnapshot());
+            }
+        }
+        std::shared_ptr<const ShardSnapshot> published(std::move(snapshot));
+        std::lock_guard lock(shard.snapshot_mutex);
+        //Старый снимок освобождается после снятия блокировки, если его больше никто не держит
+        shard.snapshot.swap(published);
+    }
+}
+
+//------------------------------------------------------
+//------------------------Tests-------------------------
+//------------------------------------------------------
+
+#include <cassert>
+#include <limits>
+#include <numeric> //std::accumulate
+#include <random>
+#include <sstream>
+
+namespace tests {
+
+    //Прежняя реализация книги с линейным подсчетом в Cheer. Используется как эталон
+    class LinearBook {
+    public:
+        explicit LinearBook(size_t pages) {
+            page_stats_.resize(pages + 1);
+        }
+
+        void Read(int reader_id, int page_num) {
+            if (!index_.count(reader_id)) {
+                index_[reader_id] = readers_amount_++;
+                readers_.push_back(page_num);
+            }
+            else {
+                int& prev_page = page_stats_[readers_[index_.at(reader_id)]];
+                if (prev_page > 0) {
+                    prev_page -= 1;
+                }
+            }
+            page_stats_[page_num] += 1;
+            readers_[index_.at(reader_id)] = page_num;
+        }
+
+        double Cheer(int reader_id) {
+            if (index_.count(reader_id) == 0) {
+                return 0;
+            }
+            else if (readers_amount_ == 1) {
+                return 1;
+            }
+            double accum = std::accumulate(page_stats_.begin(), page_stats_.begin() + readers_[index_.at(reader_id)], 0.0);
+            return accum == 0 ? 0 : accum / (readers_amount_ - 1);
+        }
+
+    private:
+        int readers_amount_ = 0;
+        std::vector<int> readers_;
+        std::vector<int> page_stats_;
+        std::unordered_map<int, int> index_;
+    };
+
+    void TestFenwickTree() {
+        FenwickTree tree(10);
+        assert(tree.PrefixSum(0) == 0);
+        assert(tree.PrefixSum(10) == 0);
+
+        tree.Add(0, 1);
+        tree.Add(3, 2);
+        tree.Add(9, 5);
+        assert(tree.PrefixSum(1) == 1);
+        assert(tree.PrefixSum(3) == 1);
+        assert(tree.PrefixSum(4) == 3);
+        assert(tree.PrefixSum(10) == 8);
+
+        tree.Add(3, -2);
+        assert(tree.PrefixSum(4) == 1);
+        assert(tree.PrefixSum(10) == 6);
+
+        std::mt19937 generator(5);
+        for (size_t size : {1, 2, 3, 8, 100, 1001}) {
+            FenwickTree random_tree(size);
+            for (int i = 0; i < 200; ++i) {
+                random_tree.Add(generator() % size, static_cast<int>(generator() % 7));
+            }
+            const std::vector<int> sums = random_tree.PrefixSums();
+            assert(sums.size() == size + 1);
+            for (size_t end = 0; end <= size; ++end) {
+                assert(sums[end] == random_tree.PrefixSum(end));
+            }
+        }
+    }
+
+    void TestBookSnapshot() {
+        std::mt19937 generator(11);
+        Book book(100);
+        for (int i = 0; i < 1000; ++i) {
+            book.Read(static_cast<int>(generator() % 50), static_cast<int>(generator() % 101));
+        }
+        const BookSnapshot snapshot = book.MakeSnapshot();
+        std::vector<double> expected;
+        for (int reader_id = -1; reader_id <= 50; ++reader_id) {
+            expected.push_back(book.Cheer(reader_id));
+            assert(snapshot.Cheer(reader_id) == expected.back());
+        }
+        //Дальнейшие изменения книги не видны в уже снятом снимке
+        for (int i = 0; i < 1000; ++i) {
+            book.Read(static_cast<int>(generator() % 60), static_cast<int>(generator() % 101));
+        }
+        for (int reader_id = -1; reader_id <= 50; ++reader_id) {
+            assert(snapshot.Cheer(reader_id) == expected[reader_id + 1]);
+        }
+    }
+
+    void TestLibrary() {
+        std::mt19937 generator(17);
+        Library library(100, 3);
+        std::unordered_map<int, Book> books;
+        for (int i = 0; i < 5000; ++i) {
+            const int book_id = static_cast<int>(generator() % 10);
+            const int reader_id = static_cast<int>(generator() % 30);
+            const int page_num = static_cast<int>(generator() % 101);
+            library.Read(book_id, reader_id, page_num);
+            books.try_emplace(book_id, 100).first->second.Read(reader_id, page_num);
+        }
+        assert(library.Cheer(-1, 0) == 0);
+        for (int book_id = 0; book_id < 10; ++book_id) {
+            for (int reader_id = 0; reader_id < 30; ++reader_id) {
+                assert(library.Cheer(book_id, reader_id) == books.at(book_id).Cheer(reader_id));
+                //До публикации снимков CheerSnapshot не видит книг
+                assert(library.CheerSnapshot(book_id, reader_id) == 0);
+            }
+        }
+        library.Publish();
+        for (int book_id = 0; book_id < 10; ++book_id) {
+            for (int reader_id = 0; reader_id < 30; ++reader_id) {
+                assert(library.CheerSnapshot(book_id, reader_id) == books.at(book_id).Cheer(reader_id));
+            }
+        }
+    }
+
+    //Потоки пишут каждый в свои книги и одновременно читают чужие, отдельный поток публикует снимки.
+    //После завершения состояние каждой книги должно совпасть с последовательным повтором ее запросов
+    void TestLibraryConcurrent() {
+        const int threads_amount = 4;
+        const int books_amount = 16;
+        const int requests_amount = 20000;
+        Library library(1000, 4);
+
+        std::atomic<bool> done = false;
+        std::thread publisher([&] {
+            while (!done) {
+                library.Publish();
+            }
+        });
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads_amount; ++t) {
+            workers.emplace_back([&library, t] {
+                std::mt19937 generator(100 + t);
+                for (int i = 0; i < requests_amount; ++i) {
+                    const int book_id = static_cast<int>(generator() % (books_amount / threads_amount)) * threads_amount + t;
+                    const int reader_id = static_cast<int>(generator() % 100);
+                    const int page_num = static_cast<int>(generator() % 1001);
+                    library.Read(book_id, reader_id, page_num);
+                    //Остальные запросы проверяют только отсутствие гонок
+                    const int other_book_id = static_cast<int>(generator() % books_amount);
+                    const double share = library.Cheer(other_book_id, reader_id);
+                    const double snapshot_share = library.CheerSnapshot(other_book_id, reader_id);
+                    assert(share >= 0 && share <= 1);
+                    assert(snapshot_share >= 0 && snapshot_share <= 1);
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        done = true;
+        publisher.join();
+        library.Publish();
+
+        std::unordered_map<int, Book> books;
+        for (int t = 0; t < threads_amount; ++t) {
+            std::mt19937 generator(100 + t);
+            for (int i = 0; i < requests_amount; ++i) {
+                const int book_id = static_cast<int>(generator() % (books_amount / threads_amount)) * threads_amount + t;
+                const int reader_id = static_cast<int>(generator() % 100);
+                const int page_num = static_cast<int>(generator() % 1001);
+                books.try_emplace(book_id, 1000).first->second.Read(reader_id, page_num);
+                generator.discard(1);
+            }
+        }
+        for (const auto& [book_id, book] : books) {
+            for (int reader_id = 0; reader_id < 100; ++reader_id) {
+                assert(library.Cheer(book_id, reader_id) == book.Cheer(reader_id));
+                assert(library.CheerSnapshot(book_id, reader_id) == book.Cheer(reader_id));
+            }
+        }
+    }
+
+    void TestParseInput() {
+        using namespace std::literals;
+        std::istringstream in(
+            "12\n"
+            "CHEER 5\n"
+            "READ 1 10\n"
+            "CHEER 1\n"
+            "READ 2 5\n"
+            "READ 3 7\n"
+            "CHEER 2\n"
+            "CHEER 3\n"
+            "READ 3 10\n"
+            "CHEER 3\n"
+            "READ 3 11\n"
+            "CHEER 3\n"
+            "CHEER 1\n"s);
+        std::ostringstream out;
+        Book book(1000);
+        ParseInput(book, in, out);
+        assert(out.str() == "0\n1\n0\n0.5\n0.5\n1\n0.5\n"s);
+
+        in.clear();
+        in.seekg(0);
+        std::ostringstream buffered_out;
+        Book buffered_book(1000);
+        ParseInputBuffered(buffered_book, in, buffered_out);
+        assert(buffered_out.str() == out.str());
+    }
+
+    void TestCommandScanner() {
+        using namespace std::literals;
+        //Маленький блок заставляет слова пересекать границы блоков
+        for (size_t block_size : {1, 2, 3, 5, 64}) {
+            std::istringstream in("  3\nCHEER  -17\r\n\tREAD 123456 789  "s);
+            CommandScanner scanner(in, block_size);
+            assert(scanner.NextNumber<size_t>() == 3);
+            assert(scanner.NextWord() == "CHEER"sv);
+            assert(scanner.NextNumber<int>() == -17);
+            assert(scanner.NextWord() == "READ"sv);
+            assert(scanner.NextNumber<int>() == 123456);
+            assert(scanner.NextNumber<int>() == 789);
+            assert(scanner.NextWord().empty());
+            assert(scanner.NextWord().empty());
+        }
+        {
+            std::istringstream in("12x"s);
+            CommandScanner scanner(in);
+            bool thrown = false;
+            try {
+                scanner.NextNumber<int>();
+            }
+            catch (const std::logic_error&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+    }
+
+    //Вывод AnswerWriter должен побайтно совпадать с выводом потока при std::setprecision(6)
+    void TestAnswerWriterFormatting() {
+        std::mt19937 generator(7);
+        std::vector<double> values = { 0, 1, 0.5, 1.0 / 3, 2.0 / 3, 1e-5, 0.1234565, 0.9999995, 123456, 1234567 };
+        for (int denominator = 1; denominator < 300; ++denominator) {
+            values.push_back(static_cast<double>(generator() % (denominator + 1)) / denominator);
+        }
+        std::ostringstream expected;
+        expected << std::setprecision(6);
+        std::ostringstream actual;
+        {
+            AnswerWriter writer(actual, 40);
+            for (double value : values) {
+                expected << value << std::endl;
+                writer.Write(value);
+            }
+        }
+        assert(actual.str() == expected.str());
+    }
+
+    //Оба способа разбора входа дают одинаковый вывод на случайных запросах
+    void TestParseInputBufferedMatchesParseInput() {
+        std::mt19937 generator(13);
+        std::ostringstream input;
+        const int requests_amount = 20000;
+        input << requests_amount << '\n';
+        for (int i = 0; i < requests_amount; ++i) {
+            const int reader_id = static_cast<int>(generator() % 500);
+            if (generator() % 3 == 0) {
+                input << "CHEER " << reader_id << '\n';
+            }
+            else {
+                input << "READ " << reader_id << ' ' << generator() % 1001 << '\n';
+            }
+        }
+
+        std::istringstream in(input.str());
+        std::ostringstream expected;
+        Book book(1000);
+        ParseInput(book, in, expected);
+
+        std::istringstream buffered_in(input.str());
+        std::ostringstream actual;
+        Book buffered_book(1000);
+        ParseInputBuffered(buffered_book, buffered_in, actual);
+
+        assert(actual.str() == expected.str());
+    }
+
+    template <typename ReaderIndex>
+    void TestReaderIndex(ReaderIndex index, int max_reader_id) {
+        assert(index.Find(0) == nullptr);
+
+        auto [page, inserted] = index.Emplace(0, 10);
+        assert(inserted && *page == 10);
+        *page = 20;
+        std::tie(page, inserted) = index.Emplace(0, 30);
+        assert(!inserted && *page == 20);
+        assert(*index.Find(0) == 20);
+
+        //Добавляем достаточно читателей, чтобы индекс несколько раз перестроился
+        std::unordered_map<int, int> expected = { { 0, 20 } };
+        std::mt19937 generator(3);
+        std::uniform_int_distribution<int> reader_dist(0, max_reader_id);
+        for (int i = 0; i < 10000; ++i) {
+            const int reader_id = reader_dist(generator);
+            const int page_num = static_cast<int>(generator() % 1001);
+            std::tie(page, inserted) = index.Emplace(reader_id, page_num);
+            assert(inserted == (expected.count(reader_id) == 0));
+            if (inserted) {
+                expected[reader_id] = page_num;
+            }
+            assert(*page == expected.at(reader_id));
+        }
+        for (int reader_id = 0; reader_id <= std::min(max_reader_id, 100000); ++reader_id) {
+            const int* found = index.Find(reader_id);
+            assert((found != nullptr) == (expected.count(reader_id) != 0));
+            assert(found == nullptr || *found == expected.at(reader_id));
+        }
+    }
+
+    void TestReaderIndexes() {
+        TestReaderIndex(FlatReaderIndex(), 100000);
+        TestReaderIndex(FlatReaderIndex(), std::numeric_limits<int>::max());
+        TestReaderIndex(DirectReaderIndex(100000), 100000);
+
+        FlatReaderIndex flat;
+        flat.Emplace(-5, 1);
+        flat.Emplace(std::numeric_limits<int>::min(), 2);
+        assert(*flat.Find(-5) == 1);
+        assert(*flat.Find(std::numeric_limits<int>::min()) == 2);
+        assert(flat.Find(5) == nullptr);
+
+        DirectReaderIndex direct(10);
+        assert(direct.Find(-1) == nullptr);
+        assert(direct.Find(11) == nullptr);
+        bool thrown = false;
+        try {
+            direct.Emplace(11, 0);
+        }
+        catch (const std::out_of_range&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    //Сравниваем ответы Cheer новой и прежней реализаций на случайных запросах
+    template <typename ReaderIndex>
+    void TestBookMatchesLinearBook(ReaderIndex index) {
+        std::mt19937 generator(42);
+        for (int pages : {1, 2, 7, 100, 1000}) {
+            for (int max_reader_id : {1, 5, 50, 1000}) {
+                BasicBook<ReaderIndex> book(pages, index);
+                LinearBook reference(pages);
+                std::uniform_int_distribution<int> page_dist(0, pages);
+                std::uniform_int_distribution<int> reader_dist(0, max_reader_id);
+                for (int i = 0; i < 5000; ++i) {
+                    const int reader_id = reader_dist(generator);
+                    if (generator() % 2 == 0) {
+                        const int page_num = page_dist(generator);
+                        book.Read(reader_id, page_num);
+                        reference.Read(reader_id, page_num);
+                    }
+                    else {
+                        assert(book.Cheer(reader_id) == reference.Cheer(reader_id));
+                    }
+                }
+            }
+        }
+    }
+}//!namespace tests
+
+//------------------------------------------------------
+//----------------------Benchmarks----------------------
+//------------------------------------------------------
+
+#include <chrono>
+#include <cmath> //std::pow
+
+namespace bench {
+
+    //Как распределены айди читателей в запросах
+    enum class IdDistribution {
+        Dense,  //Айди подряд с нуля, запросы равномерно по всем читателям
+        Sparse, //Айди разбросаны по всему диапазону int, запросы равномерно по всем читателям
+        Zipf    //Айди подряд с нуля, частота запросов к читателю убывает по закону Ципфа
+    };
+
+    struct WorkloadConfig {
+        int readers = 100000;          //Кол-во различных читателей
+        int pages = 1000;              //Кол-во страниц в книге
+        double read_share = 0.5;       //Доля READ среди запросов, остальное - CHEER
+        IdDistribution ids = IdDistribution::Dense;
+        double zipf_exponent = 1.0;
+        size_t requests = 2000000;
+        unsigned seed = 1;
+    };
+
+    struct Request {
+        bool is_read = false;
+        int reader_id = 0;
+        int page_num = 0;
+    };
+
+    //Разбирает параметры вида key=value. Неизвестный ключ или значение - исключение
+    WorkloadConfig ParseWorkloadConfig(const std::vector<std::string_view>& args) {
+        using namespace std::literals;
+        WorkloadConfig config;
+        for (std::string_view arg : args) {
+            const size_t eq = arg.find('=');
+            if (eq == std::string_view::npos) {
+                throw std::invalid_argument("Expected key=value, got "s + std::string(arg));
+            }
+            const std::string_view key = arg.substr(0, eq);
+            const std::string value(arg.substr(eq + 1));
+            if (key == "readers"sv) {
+                config.readers = std::stoi(value);
+            }
+            else if (key == "pages"sv) {
+                config.pages = std::stoi(value);
+            }
+            else if (key == "read-share"sv) {
+                config.read_share = std::stod(value);
+            }
+            else if (key == "requests"sv) {
+                config.requests = std::stoull(value);
+            }
+            else if (key == "zipf-exponent"sv) {
+                config.zipf_exponent = std::stod(value);
+            }
+            else if (key == "seed"sv) {
+                config.seed = static_cast<unsigned>(std::stoul(value));
+            }
+            else if (key == "ids"sv) {
+                if (value == "dense"s) {
+                    config.ids = IdDistribution::Dense;
+                }
+                else if (value == "sparse"s) {
+                    config.ids = IdDistribution::Sparse;
+                }
+                else if (value == "zipf"s) {
+                    config.ids = IdDistribution::Zipf;
+                }
+                else {
+                    throw std::invalid_argument("Unknown id distribution "s + value);
+                }
+            }
+            else {
+                throw std::invalid_argument("Unknown workload parameter "s + std::string(key));
+            }
+        }
+        if (config.readers < 1 || config.pages < 0 || config.read_share < 0 || config.read_share > 1) {
+            throw std::invalid_argument("Workload parameters are out of range");
+        }
+        return config;
+    }
+
+    std::string_view ToString(IdDistribution ids) {
+        using namespace std::literals;
+        switch (ids) {
+        case IdDistribution::Dense:
+            return "dense"sv;
+        case IdDistribution::Sparse:
+            return "sparse"sv;
+        case IdDistribution::Zipf:
+            return "zipf"sv;
+        }
+        return {};
+    }
+
+    std::vector<Request> GenerateWorkload(const WorkloadConfig& config) {
+        std::mt19937 generator(config.seed);
+        std::uniform_int_distribution<int> rank_dist(0, config.readers - 1);
+        std::uniform_int_distribution<int> page_dist(0, config.pages);
+        std::bernoulli_distribution read_dist(config.read_share);
+
+        //Для Ципфа заранее считаем функцию распределения по рангам читателей
+        std::vector<double> zipf_cdf;
+        if (config.ids == IdDistribution::Zipf) {
+            zipf_cdf.resize(config.readers);
+            double sum = 0;
+            for (int rank = 0; rank < config.readers; ++rank) {
+                sum += 1.0 / std::pow(rank + 1, config.zipf_exponent);
+                zipf_cdf[rank] = sum;
+            }
+        }
+        std::uniform_real_distribution<double> zipf_dist(0, zipf_cdf.empty() ? 0 : zipf_cdf.back());
+
+        std::vector<Request> requests(config.requests);
+        for (Request& request : requests) {
+            request.is_read = read_dist(generator);
+            int rank = 0;
+            if (config.ids == IdDistribution::Zipf) {
+                rank = static_cast<int>(std::lower_bound(zipf_cdf.begin(), zipf_cdf.end(), zipf_dist(generator)) - zipf_cdf.begin());
+                rank = std::min(rank, config.readers - 1);
+            }
+            else {
+                rank = rank_dist(generator);
+            }
+            //Умножение на нечетную константу - биекция на 32-битных числах, поэтому разреженные айди не совпадают
+            request.reader_id = config.ids == IdDistribution::Sparse
+                ? static_cast<int>(static_cast<uint32_t>(rank) * 2654435761u)
+                : rank;
+            request.page_num = request.is_read ? page_dist(generator) : 0;
+        }
+        return requests;
+    }
+
+    //Тот же набор запросов в текстовом формате stdin
+    std::string FormatWorkload(const std::vector<Request>& requests) {
+        std::ostringstream out;
+        out << requests.size() << '\n';
+        for (const Request& request : requests) {
+            if (request.is_read) {
+                out << "READ " << request.reader_id << ' ' << request.page_num << '\n';
+            }
+            else {
+                out << "CHEER " << request.reader_id << '\n';
+            }
+        }
+        return out.str();
+    }
+
+    void PrintLatencies(std::ostream& out, std::string_view name, std::vector<int64_t>& latencies) {
+        if (latencies.empty()) {
+            out << name << "\t0\n";
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](double p) {
+            return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+        };
+        const int64_t total = std::accumulate(latencies.begin(), latencies.end(), int64_t{ 0 });
+        out << name << '\t' << latencies.size()
+            << '\t' << std::fixed << std::setprecision(2) << latencies.size() * 1e3 / std::max<int64_t>(total, 1) << std::defaultfloat
+            << '\t' << percentile(0.5) << '\t' << percentile(0.9) << '\t' << percentile(0.99)
+            << '\t' << percentile(0.999) << '\t' << latencies.back() << '\n';
+    }
+
+    //Задержки READ и CHEER по отдельности и общая пропускная способность Book, а также
+    //пропускная способность обоих способов разбора текстового входа на том же наборе запросов.
+    //Задержка каждого запроса меряется steady_clock и включает накладные расходы самого таймера,
+    //поэтому общая пропускная способность меряется отдельным прогоном без таймеров
+    void BookWorkload(const WorkloadConfig& config, std::ostream& out) {
+        using Clock = std::chrono::steady_clock;
+        const std::vector<Request> requests = GenerateWorkload(config);
+        out << "readers=" << config.readers << " pages=" << config.pages << " read-share=" << config.read_share
+            << " ids=" << ToString(config.ids) << " requests=" << config.requests << '\n';
+
+        double checksum = 0;
+        {
+            std::vector<int64_t> read_latencies;
+            std::vector<int64_t> cheer_latencies;
+            Book book(config.pages);
+            for (const Request& request : requests) {
+                const auto start = Clock::now();
+                if (request.is_read) {
+                    book.Read(request.reader_id, request.page_num);
+                }
+                else {
+                    checksum += book.Cheer(request.reader_id);
+                }
+                const int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+                (request.is_read ? read_latencies : cheer_latencies).push_back(elapsed);
+            }
+            out << "op\tcount\tMops/s\tp50 ns\tp90 ns\tp99 ns\tp99.9 ns\tmax ns\n";
+            PrintLatencies(out, "READ", read_latencies);
+            PrintLatencies(out, "CHEER", cheer_latencies);
+        }
+
+        const auto report = [&out, &requests](std::string_view name, std::chrono::duration<double> elapsed) {
+            out << name << '\t' << std::fixed << std::setprecision(2)
+                << requests.size() / elapsed.count() / 1e6 << " Mreq/s" << std::defaultfloat << '\n';
+        };
+        {
+            Book book(config.pages);
+            const auto start = Clock::now();
+            for (const Request& request : requests) {
+                if (request.is_read) {
+                    book.Read(request.reader_id, request.page_num);
+                }
+                else {
+                    checksum += book.Cheer(request.reader_id);
+                }
+            }
+            report("Book", Clock::now() - start);
+        }
+
+        const std::string input = FormatWorkload(requests);
+        for (bool buffered : {false, true}) {
+            std::istringstream in(input);
+            std::ostringstream answers;
+            Book book(config.pages);
+            const auto start = Clock::now();
+            if (buffered) {
+                ParseInputBuffered(book, in, answers);
+            }
+            else {
+                ParseInput(book, in, answers);
+            }
+            report(buffered ? "ParseInputBuffered" : "ParseInput", Clock::now() - start);
+        }
+
+        //Не даем компилятору выбросить вычисления
+        if (checksum < 0) {
+            std::cerr << checksum;
+        }
+    }
+
+    //Пропускная способность Library при росте числа потоков от 1 до числа ядер (но не меньше 4).
+    //Каждый поток выполняет поровну READ и CHEER по случайным книгам;
+    //в режиме снимков CHEER идут через CheerSnapshot, а отдельный поток публикует снимки
+    void LibraryScaling(std::ostream& out) {
+        const int books_amount = 1024;
+        const int readers_amount = 10000;
+        const int requests_per_thread = 1000000;
+        const unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+
+        out << "threads\tlocked Mops/s\tsnapshot Mops/s\n";
+        for (unsigned threads_amount = 1; threads_amount <= max_threads; threads_amount *= 2) {
+            out << threads_amount;
+            for (bool use_snapshot : {false, true}) {
+                Library library(1000);
+                std::atomic<bool> done = false;
+                std::thread publisher([&] {
+                    while (use_snapshot && !done) {
+                        library.Publish();
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                });
+
+                const auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> workers;
+                for (unsigned t = 0; t < threads_amount; ++t) {
+                    workers.emplace_back([&library, use_snapshot, t] {
+                        std::mt19937 generator(t);
+                        double checksum = 0;
+                        for (int i = 0; i < requests_per_thread; ++i) {
+                            const int book_id = static_cast<int>(generator() % books_amount);
+                            const int reader_id = static_cast<int>(generator() % readers_amount);
+                            if (i % 2 == 0) {
+                                library.Read(book_id, reader_id, static_cast<int>(generator() % 1001));
+                            }
+                            else {
+                                checksum += use_snapshot ? library.CheerSnapshot(book_id, reader_id) : library.Cheer(book_id, reader_id);
+                            }
+                        }
+                        //Не даем компилятору выбросить вычисления
+                        if (checksum < 0) {
+                            std::cerr << checksum;
+                        }
+                    });
+                }
+                for (std::thread& worker : workers) {
+                    worker.join();
+                }
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                done = true;
+                publisher.join();
+
+                out << '\t' << std::fixed << std::setprecision(2)
+                    << threads_amount * requests_per_thread / elapsed.count() / 1e6;
+            }
+            out << std::defaultfloat << '\n';
+        }
+    }
+}//!namespace bench
+
+int main(int argc, char* argv[]) {
+    using namespace std::literals;
+    tests::TestFenwickTree();
+    tests::TestParseInput();
+    tests::TestCommandScanner();
+    tests::TestAnswerWriterFormatting();
+    tests::TestParseInputBufferedMatchesParseInput();
+    tests::TestReaderIndexes();
+    tests::TestBookMatchesLinearBook(FlatReaderIndex());
+    tests::TestBookMatchesLinearBook(DirectReaderIndex(1000));
+    tests::TestBookSnapshot();
+    tests::TestLibrary();
+    tests::TestLibraryConcurrent();
+    if (argc > 1 && argv[1] == "--bench-library"sv) {
+        bench::LibraryScaling(std::cout);
+        return 0;
+    }
+    if (argc > 1 && argv[1] == "--bench"sv) {
+        //Например: --bench readers=1000000 pages=10000 read-share=0.2 ids=zipf requests=5000000
+        bench::BookWorkload(bench::ParseWorkloadConfig({ argv + 2, argv + argc }), std::cout);
+        return 0;
+    }
     size_t MAX_PAGE_AMOUNT = 1000;
     Book book(MAX_PAGE_AMOUNT);
-    ParseInput(book);
+    ParseInputBuffered(book);
     return 0;
 }
\ No newline at end of file
@@ -1,10 +1,24 @@
 #include <algorithm>
+#include <atomic>
+#include <charconv> //std::from_chars
+#include <cstdint>
+#include <cstring> //std::memchr
+#include <fstream>
 #include <iostream>
+#include <iterator> //std::make_move_iterator
+#include <memory> //std::shared_ptr
+#include <mutex>
+#include <set>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 #include <string_view>
+#include <thread>
 #include <vector>
 
+#include "MappedFile.h"
+
 class Domain {
 public:
     Domain(std::string domain);
@@ -13,20 +27,162 @@ public:
     bool operator==(const Domain& other) const noexcept;
     bool operator<(const Domain& other) const noexcept;
     bool IsSubdomain(const Domain& other) const noexcept;
+    // Перевернутое имя домена с завершающей точкой, например "moc.elpmaxe."
+    std::string_view Reversed() const noexcept;
 
 private:
     std::string domain_;
 };
 
-class DomainChecker {
+// Домен, который ничего не копирует, а ссылается на имя в чужом буфере, например в отображенном в память файле.
+// Сравнения те же, что у Domain, но выполняются справа налево прямо по исходному имени,
+// без построения перевернутой строки. Буфер должен жить дольше объекта
+class DomainView {
+public:
+    DomainView(std::string_view domain) noexcept;
+
+    bool operator==(const DomainView& other) const noexcept;
+    bool operator<(const DomainView& other) const noexcept;
+    bool IsSubdomain(const DomainView& other) const noexcept;
+
+private:
+    std::string_view domain_;
+};
+
+// Признак того, что список уже отсортирован и схлопнут (см. CollapseDomains) и его не нужно обрабатывать заново
+struct CollapsedDomainsTag {};
+inline constexpr CollapsedDomainsTag COLLAPSED_DOMAINS{};
+
+template <typename DomainType>
+class BasicDomainChecker {
+public:
+    template<typename InputIt>
+    BasicDomainChecker(InputIt begin, InputIt end);
+    template<typename InputIt>
+    BasicDomainChecker(CollapsedDomainsTag, InputIt begin, InputIt end);
+
+    bool IsForbidden(const DomainType& domain) const noexcept;
+
+private:
+    std::vector<DomainType> forbidden_domains_;
+};
+
+using DomainChecker = BasicDomainChecker<Domain>;
+using DomainViewChecker = BasicDomainChecker<DomainView>;
+
+// Список запрещенных доменов, который можно менять, не перестраивая его целиком.
+// Add и Remove поддерживают схлопнутый список за O(log N + k), где k - число затронутых поддоменов.
+// Читатели работают с неизменяемым снимком, который Publish подменяет новым, а изменения
+// становятся видны после Publish. IsForbidden не ждет ни Add/Remove, ни сборки снимка:
+// под коротким snapshot_mutex_ копируется только указатель, так что читатель может подождать
+// лишь такого же копирования или подмены указателя. Сама проверка идет без блокировок.
+// Publish копирует все строки схлопнутого списка в новый снимок: O(N) времени и памяти
+// на каждый вызов, для нескольких миллионов доменов - десятые доли секунды
+class ReloadableDomainChecker {
+public:
+    template<typename InputIt>
+    ReloadableDomainChecker(InputIt begin, InputIt end);
+
+    void Add(const Domain& domain);
+    // Убирает домен из списка. Поддомены, перечисленные явно, остаются запрещенными
+    void Remove(const Domain& domain);
+    void Publish();
+
+    bool IsForbidden(const Domain& domain) const noexcept;
+
+private:
+    // Заносит домен в схлопнутый список, если его еще не покрывает другой, и убирает покрытые им поддомены
+    void AddCollapsed(const Domain& domain);
+
+    std::mutex mutex_;              // Сериализует писателей
+    std::set<Domain> listed_;       // Все явно перечисленные домены
+    std::set<Domain> collapsed_;    // Те из них, что не лежат под другими перечисленными
+    // Под snapshot_mutex_ только копируется или подменяется указатель, сам снимок неизменяем
+    mutable std::mutex snapshot_mutex_;
+    std::shared_ptr<const DomainChecker> snapshot_;
+};
+
+// Альтернатива DomainChecker: префиксное дерево по меткам перевернутого домена.
+// Проверка идет одним проходом по символам перевернутого имени и останавливается на первом запрещенном суффиксе.
+// Все ребра дерева лежат в одной хеш-таблице с открытой адресацией, метки - в общем буфере,
+// поэтому на каждую метку запроса приходится одна проба в таблицу вместо сравнений строк
+class DomainTrie {
+public:
+    template<typename InputIt>
+    DomainTrie(InputIt begin, InputIt end);
+
+    bool IsForbidden(const Domain& domain) const noexcept;
+
+private:
+    // Переход из узла parent по метке в узел child. Ключ в таблице - пара (parent, метка)
+    struct Edge {
+        uint64_t hash = 0;           // Хеш ключа целиком
+        uint32_t parent = NO_NODE;   // NO_NODE помечает свободную ячейку
+        uint32_t child = 0;
+        uint32_t label_offset = 0;   // Метка ребра - подстрока labels_
+        uint32_t label_size = 0;
+        bool forbidden = false;      // Домен, оканчивающийся этим ребром, запрещен вместе со всеми поддоменами
+    };
+
+    static constexpr uint32_t ROOT = 0;
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+    static constexpr uint64_t LABEL_HASH_SEED = 14695981039346656037ull;
+
+    // Хеш метки считается посимвольно (FNV-1a) в том же проходе, что ищет точки
+    static uint64_t HashLabelChar(uint64_t hash, char c) noexcept;
+    static uint64_t HashEdge(uint32_t parent, uint64_t label_hash) noexcept;
+
+    std::string_view Label(const Edge& edge) const noexcept;
+    const Edge* FindEdge(uint32_t parent, uint64_t label_hash, std::string_view label) const noexcept;
+    Edge& FindOrInsertEdge(uint32_t parent, uint64_t label_hash, std::string_view label);
+
+    std::vector<Edge> edges_;
+    std::string labels_;
+    uint32_t nodes_amount_ = 1;
+};
+
+// Заранее собранный список запрещенных доменов в двоичном файле, который отображается в память как есть.
+// Формат (порядок байт машины, на которой файл собран):
+//   BlocklistHeader
+//   uint64_t offsets[domains_amount + 1] - начала имен в блоке имен, последнее значение равно names_size
+//   char names[names_size]               - перевернутые имена с точкой, отсортированы и схлопнуты
+// Открытие проверяет за O(1) только заголовок, версию и размеры, так что файл с чужим форматом
+// или обрезанный файл не открывается, а сам файл при открытии не читается.
+// Смещения проверяются лениво при каждом чтении имени: поиск по испорченному файлу может дать
+// неверный ответ, но не выходит за его границы. Полную проверку смещений и контрольной суммы
+// за один проход по файлу делает Verify, ее вызывает сборка списка и ключ --verify
+class CompiledDomainChecker {
 public:
+    static constexpr char MAGIC[8] = { 'D', 'O', 'M', 'B', 'L', 'O', 'C', 'K' };
+    static constexpr uint32_t VERSION = 1;
+
+    struct BlocklistHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t domains_amount;
+        uint64_t names_size;
+        uint64_t checksum;        // FNV-1a по смещениям и блоку имен
+    };
+
+    explicit CompiledDomainChecker(const std::string& path);
+
+    // Схлопывает список и записывает его в формате, который читает конструктор
     template<typename InputIt>
-    DomainChecker(InputIt begin, InputIt end);
+    static void Compile(InputIt begin, InputIt end, std::ostream& out);
 
     bool IsForbidden(const Domain& domain) const noexcept;
+    // Смещения не убывают и контрольная сумма совпадает. Читает весь файл
+    bool Verify() const noexcept;
 
 private:
-    std::vector<Domain> forbidden_domains_;
+    static uint64_t Checksum(std::string_view payload, uint64_t hash = 14695981039346656037ull) noexcept;
+    std::string_view Name(size_t index) const noexcept;
+
+    MappedFile file_;
+    BlocklistHeader header_ {};
+    const uint64_t* offsets_ = nullptr;
+    const char* names_ = nullptr;
 };
 
 //------------------------------------------------------
@@ -58,31 +214,83 @@ bool Domain::IsSubdomain(const Domain& other) const noexcept {
     return domain_.find(other.domain_) == 0;
 }
 
+std::string_view Domain::Reversed() const noexcept {
+    return domain_;
+}
+
 //------------------------------------------------------
-//--------------------DomainChecker---------------------
+//----------------------DomainView----------------------
 //------------------------------------------------------
 
-template<typename InputIt>
-DomainChecker::DomainChecker(InputIt begin, InputIt end) : forbidden_domains_(begin, end) {
+DomainView::DomainView(std::string_view domain) noexcept
+    : domain_(domain) {
+}
+
+bool DomainView::operator==(const DomainView& other) const noexcept {
+    return domain_ == other.domain_;
+}
+
+bool DomainView::operator<(const DomainView& other) const noexcept {
+    // Порядок тот же, что у перевернутых имен с завершающей точкой в Domain.
+    // Идем с конца имен до первого различия, точку в конце подставляем мысленно
+    const auto [mine, theirs] = std::mismatch(domain_.rbegin(), domain_.rend(), other.domain_.rbegin(), other.domain_.rend());
+    if (theirs == other.domain_.rend()) {
+        // Другое имя закончилось: сравниваем наш символ с его завершающей точкой.
+        // Если закончились оба, имена равны
+        return mine != domain_.rend() && *mine < '.';
+    }
+    if (mine == domain_.rend()) {
+        // Наше имя закончилось: наша точка либо меньше символа другого имени,
+        // либо совпадает с ним, и тогда мы - префикс другого имени
+        return !(*theirs < '.');
+    }
+    return *mine < *theirs;
+}
+
+bool DomainView::IsSubdomain(const DomainView& other) const noexcept {
+    // Другое имя должно быть концом нашего и начинаться с границы метки
+    return domain_.ends_with(other.domain_)
+        && (domain_.size() == other.domain_.size() || domain_[domain_.size() - other.domain_.size() - 1] == '.');
+}
+
+// Оставляет в списке только домены, не являющиеся поддоменами других, в порядке возрастания
+template <typename DomainType>
+void CollapseDomains(std::vector<DomainType>& domains) {
     // Сортируем список запрещенных доменов по возрастанию.
-    std::sort(forbidden_domains_.begin(), forbidden_domains_.end());
+    std::sort(domains.begin(), domains.end());
 
     // Удаляем дубликаты и поддомены из списка запрещенных доменов.
     // Для этого используем алгоритм std::unique с пользовательским компаратором,
     // который проверяет, что один домен из пары - поддомен другого.
-    forbidden_domains_.erase(
+    domains.erase(
         std::unique(
-            forbidden_domains_.begin(), forbidden_domains_.end(),
-            [](const Domain& a, const Domain& b) {
+            domains.begin(), domains.end(),
+            [](const DomainType& a, const DomainType& b) {
                 return b.IsSubdomain(a);
             }),
-        forbidden_domains_.end()
+        domains.end()
     );
 }
 
-bool DomainChecker::IsForbidden(const Domain& domain) const noexcept {
+//------------------------------------------------------
+//--------------------DomainChecker---------------------
+//------------------------------------------------------
+
+template <typename DomainType>
+template<typename InputIt>
+BasicDomainChecker<DomainType>::BasicDomainChecker(InputIt begin, InputIt end) : forbidden_domains_(begin, end) {
+    CollapseDomains(forbidden_domains_);
+}
+
+template <typename DomainType>
+template<typename InputIt>
+BasicDomainChecker<DomainType>::BasicDomainChecker(CollapsedDomainsTag, InputIt begin, InputIt end) : forbidden_domains_(begin, end) {
+}
+
+template <typename DomainType>
+bool BasicDomainChecker<DomainType>::IsForbidden(const DomainType& domain) const noexcept {
     // Используем бинарный поиск для проверки, является ли домен запрещенным.
-    std::vector<Domain>::const_iterator it = std::upper_bound(forbidden_domains_.begin(), forbidden_domains_.end(), domain);
+    typename std::vector<DomainType>::const_iterator it = std::upper_bound(forbidden_domains_.begin(), forbidden_domains_.end(), domain);
     if (it != forbidden_domains_.begin()) {
         //Если домен не найден в запрещенных, надо проверить предыдущий итератор от найденного upper_bound на субдомен.
         return domain.IsSubdomain(*(--it));
@@ -90,6 +298,349 @@ bool DomainChecker::IsForbidden(const Domain& domain) const noexcept {
     return false;  // Если поддомен не найден, возвращаем false.
 }
 
+//------------------------------------------------------
+//----------------------DomainTrie----------------------
+//------------------------------------------------------
+
+template<typename InputIt>
+DomainTrie::DomainTrie(InputIt begin, InputIt end) {
+    // После схлопывания ни один домен не лежит под другим запрещенным,
+    // поэтому запрещенные ребра всегда оказываются листьями
+    std::vector<Domain> forbidden_domains(begin, end);
+    CollapseDomains(forbidden_domains);
+
+    // Ребер не больше, чем меток во всех доменах. Заполняем таблицу не более чем наполовину
+    size_t labels_amount = 0;
+    for (const Domain& domain : forbidden_domains) {
+        labels_amount += std::count(domain.Reversed().begin(), domain.Reversed().end(), '.');
+    }
+    size_t capacity = 2;
+    while (capacity < labels_amount * 2) {
+        capacity *= 2;
+    }
+    edges_.resize(capacity);
+
+    for (const Domain& domain : forbidden_domains) {
+        const std::string_view reversed = domain.Reversed();
+        uint32_t node = ROOT;
+        uint64_t label_hash = LABEL_HASH_SEED;
+        size_t label_start = 0;
+        // Перевернутое имя всегда оканчивается точкой, поэтому каждая метка заканчивается на '.'
+        for (size_t pos = 0; pos < reversed.size(); ++pos) {
+            if (reversed[pos] != '.') {
+                label_hash = HashLabelChar(label_hash, reversed[pos]);
+                continue;
+            }
+            Edge& edge = FindOrInsertEdge(node, label_hash, reversed.substr(label_start, pos - label_start));
+            if (pos + 1 == reversed.size()) {
+                edge.forbidden = true;
+            }
+            node = edge.child;
+            label_hash = LABEL_HASH_SEED;
+            label_start = pos + 1;
+        }
+    }
+}
+
+uint64_t DomainTrie::HashLabelChar(uint64_t hash, char c) noexcept {
+    return (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+}
+
+uint64_t DomainTrie::HashEdge(uint32_t parent, uint64_t label_hash) noexcept {
+    // Финальное перемешивание из MurmurHash3, чтобы младшие биты зависели от всего ключа
+    uint64_t hash = label_hash ^ (static_cast<uint64_t>(parent) * 0x9E3779B97F4A7C15ull);
+    hash = (hash ^ (hash >> 33)) * 0xFF51AFD7ED558CCDull;
+    hash = (hash ^ (hash >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    return hash ^ (hash >> 33);
+}
+
+std::string_view DomainTrie::Label(const Edge& edge) const noexcept {
+    return std::string_view(labels_).substr(edge.label_offset, edge.label_size);
+}
+
+const DomainTrie::Edge* DomainTrie::FindEdge(uint32_t parent, uint64_t label_hash, std::string_view label) const noexcept {
+    const uint64_t hash = HashEdge(parent, label_hash);
+    const size_t mask = edges_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Edge& edge = edges_[i];
+        if (edge.parent == NO_NODE) {
+            return nullptr;
+        }
+        if (edge.hash == hash && edge.parent == parent && Label(edge) == label) {
+            return &edge;
+        }
+    }
+}
+
+DomainTrie::Edge& DomainTrie::FindOrInsertEdge(uint32_t parent, uint64_t label_hash, std::string_view label) {
+    const uint64_t hash = HashEdge(parent, label_hash);
+    const size_t mask = edges_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Edge& edge = edges_[i];
+        if (edge.parent == NO_NODE) {
+            edge = { hash, parent, nodes_amount_++, static_cast<uint32_t>(labels_.size()), static_cast<uint32_t>(label.size()) };
+            labels_.append(label);
+            return edge;
+        }
+        if (edge.hash == hash && edge.parent == parent && Label(edge) == label) {
+            return edge;
+        }
+    }
+}
+
+bool DomainTrie::IsForbidden(const Domain& domain) const noexcept {
+    const std::string_view reversed = domain.Reversed();
+    uint32_t node = ROOT;
+    uint64_t label_hash = LABEL_HASH_SEED;
+    size_t label_start = 0;
+    for (size_t pos = 0; pos < reversed.size(); ++pos) {
+        if (reversed[pos] != '.') {
+            label_hash = HashLabelChar(label_hash, reversed[pos]);
+            continue;
+        }
+        const Edge* edge = FindEdge(node, label_hash, reversed.substr(label_start, pos - label_start));
+        if (edge == nullptr) {
+            return false;
+        }
+        if (edge->forbidden) {
+            return true;
+        }
+        node = edge->child;
+        label_hash = LABEL_HASH_SEED;
+        label_start = pos + 1;
+    }
+    return false;
+}
+
+//------------------------------------------------------
+//---------------ReloadableDomainChecker----------------
+//------------------------------------------------------
+
+template<typename InputIt>
+ReloadableDomainChecker::ReloadableDomainChecker(InputIt begin, InputIt end) {
+    // Из отсортированного диапазона множества строятся за линейное время
+    std::vector<Domain> domains(begin, end);
+    std::sort(domains.begin(), domains.end());
+    listed_ = std::set<Domain>(domains.begin(), domains.end());
+    CollapseDomains(domains);
+    collapsed_ = std::set<Domain>(std::make_move_iterator(domains.begin()), std::make_move_iterator(domains.end()));
+    Publish();
+}
+
+void ReloadableDomainChecker::AddCollapsed(const Domain& domain) {
+    // Домен покрыт, если его предок - ближайший меньший элемент схлопнутого списка
+    auto it = collapsed_.upper_bound(domain);
+    if (it != collapsed_.begin() && domain.IsSubdomain(*std::prev(it))) {
+        return;
+    }
+    it = collapsed_.insert(it, domain);
+    // Поддомены идут в порядке сортировки сразу за доменом одним отрезком
+    const auto children_begin = std::next(it);
+    auto children_end = children_begin;
+    while (children_end != collapsed_.end() && children_end->IsSubdomain(domain)) {
+        ++children_end;
+    }
+    collapsed_.erase(children_begin, children_end);
+}
+
+void ReloadableDomainChecker::Add(const Domain& domain) {
+    std::lock_guard lock(mutex_);
+    if (listed_.insert(domain).second) {
+        AddCollapsed(domain);
+    }
+}
+
+void ReloadableDomainChecker::Remove(const Domain& domain) {
+    std::lock_guard lock(mutex_);
+    if (listed_.erase(domain) == 0 || collapsed_.erase(domain) == 0) {
+        // Домена не было, либо его и так покрывает другой перечисленный домен
+        return;
+    }
+    // Домен был в схлопнутом списке, значит перечисленных предков у него нет.
+    // Возвращаем явно перечисленные поддомены, не покрытые друг другом
+    for (auto it = listed_.lower_bound(domain); it != listed_.end() && it->IsSubdomain(domain); ++it) {
+        AddCollapsed(*it);
+    }
+}
+
+void ReloadableDomainChecker::Publish() {
+    std::shared_ptr<const DomainChecker> snapshot;
+    {
+        std::lock_guard lock(mutex_);
+        // Список уже отсортирован и схлопнут, поэтому снимок строится простым копированием
+        snapshot = std::make_shared<const DomainChecker>(COLLAPSED_DOMAINS, collapsed_.begin(), collapsed_.end());
+    }
+    std::lock_guard lock(snapshot_mutex_);
+    // Старый снимок освобождается после снятия блокировки, если его больше никто не держит
+    snapshot_.swap(snapshot);
+}
+
+bool ReloadableDomainChecker::IsForbidden(const Domain& domain) const noexcept {
+    std::shared_ptr<const DomainChecker> snapshot;
+    {
+        std::lock_guard lock(snapshot_mutex_);
+        snapshot = snapshot_;
+    }
+    return snapshot->IsForbidden(domain);
+}
+
+//------------------------------------------------------
+//----------------CompiledDomainChecker-----------------
+//------------------------------------------------------
+
+CompiledDomainChecker::CompiledDomainChecker(const std::string& path)
+    : file_(path) {
+    const std::string_view data = file_.Data();
+    if (data.size() < sizeof(BlocklistHeader)) {
+        throw std::runtime_error(path + ": blocklist is too short");
+    }
+    std::memcpy(&header_, data.data(), sizeof(header_));
+    if (!std::equal(std::begin(MAGIC), std::end(MAGIC), header_.magic)) {
+        throw std::runtime_error(path + ": not a compiled blocklist");
+    }
+    if (header_.version != VERSION) {
+        // Сюда же попадает файл, собранный на машине с другим порядком байт
+        throw std::runtime_error(path + ": unsupported blocklist version");
+    }
+    // Размеры из заголовка не складываются и не умножаются до проверки границ:
+    // подобранные значения иначе могли бы переполниться и дать в сумме размер файла
+    const size_t body_size = data.size() - sizeof(header_);
+    if (header_.domains_amount >= body_size / sizeof(uint64_t)
+        || header_.names_size != body_size - (header_.domains_amount + 1) * sizeof(uint64_t)) {
+        throw std::runtime_error(path + ": blocklist size does not match its header");
+    }
+    // Заголовок занимает 40 байт, поэтому смещения выровнены по 8 байт от начала отображения
+    offsets_ = reinterpret_cast<const uint64_t*>(data.data() + sizeof(header_));
+    names_ = data.data() + sizeof(header_) + (header_.domains_amount + 1) * sizeof(uint64_t);
+    // Крайние смещения читаются за O(1). Остальные проверяет Name при чтении и Verify целиком
+    if (offsets_[0] != 0 || offsets_[header_.domains_amount] != header_.names_size) {
+        throw std::runtime_error(path + ": blocklist offsets are corrupted");
+    }
+}
+
+template<typename InputIt>
+void CompiledDomainChecker::Compile(InputIt begin, InputIt end, std::ostream& out) {
+    std::vector<Domain> domains(begin, end);
+    CollapseDomains(domains);
+
+    std::vector<uint64_t> offsets;
+    offsets.reserve(domains.size() + 1);
+    std::string names;
+    for (const Domain& domain : domains) {
+        offsets.push_back(names.size());
+        names.append(domain.Reversed());
+    }
+    offsets.push_back(names.size());
+
+    const std::string_view offsets_bytes(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    BlocklistHeader header {};
+    std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+    header.version = VERSION;
+    header.domains_amount = domains.size();
+    header.names_size = names.size();
+    header.checksum = Checksum(names, Checksum(offsets_bytes));
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(offsets_bytes.data(), static_cast<std::streamsize>(offsets_bytes.size()));
+    out.write(names.data(), static_cast<std::streamsize>(names.size()));
+}
+
+uint64_t CompiledDomainChecker::Checksum(std::string_view payload, uint64_t hash) noexcept {
+    for (char c : payload) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool CompiledDomainChecker::Verify() const noexcept {
+    // Неубывающие смещения от 0 до names_size гарантируют, что каждое имя лежит внутри блока имен
+    bool offsets_ok = true;
+    for (size_t i = 0; i < header_.domains_amount; ++i) {
+        offsets_ok &= offsets_[i] <= offsets_[i + 1];
+    }
+    // Порчу самих имен ловит только контрольная сумма
+    const std::string_view offsets_bytes(reinterpret_cast<const char*>(offsets_), (header_.domains_amount + 1) * sizeof(uint64_t));
+    return offsets_ok && Checksum({ names_, header_.names_size }, Checksum(offsets_bytes)) == header_.checksum;
+}
+
+std::string_view CompiledDomainChecker::Name(size_t index) const noexcept {
+    // Испорченные смещения прижимаются к блоку имен: ответ неверный, но чтение не выходит за файл
+    const uint64_t end = std::min(offsets_[index + 1], header_.names_size);
+    const uint64_t begin = std::min(offsets_[index], end);
+    return { names_ + begin, end - begin };
+}
+
+bool CompiledDomainChecker::IsForbidden(const Domain& domain) const noexcept {
+    // Тот же поиск, что в DomainChecker: ищем последний запрещенный домен не больше данного
+    // и проверяем, что он - начало перевернутого имени. Сравнение посимвольное, как в Domain::operator<
+    const std::string_view reversed = domain.Reversed();
+    size_t left = 0;
+    size_t right = header_.domains_amount;
+    while (left < right) {
+        const size_t middle = left + (right - left) / 2;
+        const std::string_view name = Name(middle);
+        if (std::lexicographical_compare(reversed.begin(), reversed.end(), name.begin(), name.end())) {
+            right = middle;
+        }
+        else {
+            left = middle + 1;
+        }
+    }
+    return left > 0 && reversed.starts_with(Name(left - 1));
+}
+
+//------------------------------------------------------
+//------------------------Batch-------------------------
+//------------------------------------------------------
+
+// Проверяет пачку доменов параллельно. IsForbidden у всех реализаций константный и noexcept,
+// поэтому потоки разбирают общий checker без синхронизации. Пачка режется на куски по BATCH_CHUNK_SIZE
+// доменов, которые потоки забирают по очереди, так что медленные куски не задерживают остальные.
+// Результат идет в порядке входа: result[i] != 0, если domains[i] запрещен.
+// vector<char> вместо vector<bool>, чтобы потоки писали в разные байты, а не в общие слова
+constexpr size_t BATCH_CHUNK_SIZE = 4096;
+
+template <typename Checker, typename DomainType>
+std::vector<char> IsForbiddenBatch(const Checker& checker, std::span<const DomainType> domains,
+                                   unsigned threads_amount = std::thread::hardware_concurrency()) {
+    std::vector<char> result(domains.size());
+    const size_t chunks_amount = (domains.size() + BATCH_CHUNK_SIZE - 1) / BATCH_CHUNK_SIZE;
+    std::atomic<size_t> next_chunk = 0;
+
+    const auto worker = [&] {
+        for (size_t chunk = next_chunk++; chunk < chunks_amount; chunk = next_chunk++) {
+            const size_t end = std::min(domains.size(), (chunk + 1) * BATCH_CHUNK_SIZE);
+            for (size_t i = chunk * BATCH_CHUNK_SIZE; i < end; ++i) {
+                result[i] = checker.IsForbidden(domains[i]);
+            }
+        }
+    };
+
+    // Текущий поток тоже работает, дополнительных потоков не больше, чем кусков
+    const size_t extra_threads = std::min<size_t>(std::max(threads_amount, 1u) - 1, chunks_amount > 0 ? chunks_amount - 1 : 0);
+    std::vector<std::jthread> threads;
+    threads.reserve(extra_threads);
+    for (size_t i = 0; i < extra_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    threads.clear();
+
+    return result;
+}
+
+// Пишет ответы одной записью в поток вместо сброса буфера после каждой строки
+void WriteVerdicts(const std::vector<char>& forbidden, std::ostream& out) {
+    using namespace std::literals;
+    std::string text;
+    text.reserve(forbidden.size() * "Good\n"sv.size());
+    for (char is_forbidden : forbidden) {
+        text.append(is_forbidden ? "Bad\n"sv : "Good\n"sv);
+    }
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    out.flush();
+}
+
 //------------------------------------------------------
 //--------------------Misc Functions--------------------
 //------------------------------------------------------
@@ -118,11 +669,49 @@ Number ReadNumberOnLine(std::istream& input) {
     return num;
 }
 
+// Отрезает от начала текста очередную строку без символа перевода строки, как std::getline
+std::string_view CutLine(std::string_view& text) noexcept {
+    const char* newline = static_cast<const char*>(std::memchr(text.data(), '\n', text.size()));
+    const size_t size = newline == nullptr ? text.size() : newline - text.data();
+    const std::string_view line = text.substr(0, size);
+    text.remove_prefix(std::min(size + 1, text.size()));
+    return line;
+}
+
+template <typename Number>
+Number ReadNumberOnLine(std::string_view& text) {
+    std::string_view line = CutLine(text);
+    // Как и operator>>, пропускаем ведущие пробельные символы
+    line.remove_prefix(std::min(line.find_first_not_of(" \t\r"), line.size()));
+
+    Number num = 0;
+    std::from_chars(line.data(), line.data() + line.size(), num);
+
+    return num;
+}
+
+// Домены ссылаются на сам текст, поэтому он должен жить дольше результата
+template <typename Number>
+std::vector<DomainView> ReadDomains(std::string_view& text, Number number) {
+    std::vector<DomainView> result;
+    result.reserve(number);
+
+    for (size_t i = 0; i < number; ++i) {
+        result.emplace_back(CutLine(text));
+    }
+
+    return result;
+}
+
 //------------------------------------------------------
 //------------------------Tests-------------------------
 //------------------------------------------------------
 
 #include <cassert>
+#include <cstddef> //offsetof
+#include <filesystem>
+#include <limits>
+#include <random>
 
 namespace tests {
 
@@ -142,52 +731,469 @@ namespace tests {
     }
 
     // Определяем пользовательскую функцию для тестирования класса DomainChecker
+    // и других реализаций с тем же интерфейсом
+    template <typename Checker, typename DomainType = Domain>
     void TestDomainChecker() {
         {
             // Создаем список запрещенных доменов для тестирования
-            std::vector<Domain> forbidden_domains = {
-                Domain("example.com"),
-                Domain("google.com"),
-                Domain("test.com"),
-                Domain("sub.example.com"),
-                Domain("mail.google.com")
+            std::vector<DomainType> forbidden_domains = {
+                DomainType("example.com"),
+                DomainType("google.com"),
+                DomainType("test.com"),
+                DomainType("sub.example.com"),
+                DomainType("mail.google.com")
             };
 
-            DomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+            Checker checker(forbidden_domains.begin(), forbidden_domains.end());
 
             // Проверяем IsForbidden
+            assert(checker.IsForbidden(DomainType("example.com")));
+            assert(!checker.IsForbidden(DomainType("")));
+            assert(!checker.IsForbidden(DomainType("subexample.com")));
+            assert(checker.IsForbidden(DomainType("google.com")));
+            assert(checker.IsForbidden(DomainType("sub.example.com")));
+            assert(checker.IsForbidden(DomainType("mail.google.com")));
+            assert(!checker.IsForbidden(DomainType("example.org")));
+            assert(!checker.IsForbidden(DomainType("m.example.org")));
+            assert(!checker.IsForbidden(DomainType("google.org")));
+            assert(!checker.IsForbidden(DomainType("test.org")));
+        }
+        {
+            // Тестируем пустой список запрещенных доменов
+            std::vector<DomainType> forbidden_domains;
+            Checker checker(forbidden_domains.begin(), forbidden_domains.end());
+            assert(!checker.IsForbidden(DomainType("example.com")));
+            assert(!checker.IsForbidden(DomainType("")));
+            assert(!checker.IsForbidden(DomainType("subexample.com")));
+            assert(!checker.IsForbidden(DomainType("sub.example.com")));
+        }
+        {
+            // Пустые метки и запрет пустого домена
+            std::vector<DomainType> forbidden_domains = { DomainType(""), DomainType("a..b"), DomainType("c.") };
+            Checker checker(forbidden_domains.begin(), forbidden_domains.end());
+            assert(checker.IsForbidden(DomainType("")));
+            assert(checker.IsForbidden(DomainType("x.a..b")));
+            assert(!checker.IsForbidden(DomainType("a.b")));
+            assert(checker.IsForbidden(DomainType("c.")));
+            assert(checker.IsForbidden(DomainType("com.")));
+            assert(!checker.IsForbidden(DomainType("c")));
+        }
+    }
+
+    // Случайное имя из коротких меток маленького алфавита, чтобы чаще совпадали суффиксы
+    std::string RandomDomainName(std::mt19937& generator) {
+        static const std::vector<std::string> labels = { "", "a", "b", "ab", "a-b", "ba", "com" };
+        std::string name = labels[generator() % labels.size()];
+        for (size_t count = generator() % 4; count > 0; --count) {
+            name = labels[generator() % labels.size()] + '.' + name;
+        }
+        return name;
+    }
+
+    void TestDomainView() {
+        assert(DomainView("example.com") == DomainView("example.com"));
+        assert(!(DomainView("example.com") == DomainView("anotherdomain.com")));
+
+        assert(DomainView("google.com").IsSubdomain(DomainView("com")));
+        assert(!DomainView("google.com").IsSubdomain(DomainView("m")));
+        assert(!DomainView("example.com").IsSubdomain(DomainView("google.com")));
+        assert(DomainView("mail.google.com").IsSubdomain(DomainView("google.com")));
+        assert(!DomainView("mailgoogle.com").IsSubdomain(DomainView("google.com")));
+        assert(!DomainView("example.com").IsSubdomain(DomainView("sub.example.com")));
+
+        // Сравнения DomainView совпадают со сравнениями Domain на случайных парах
+        std::mt19937 generator(1);
+        for (int i = 0; i < 10000; ++i) {
+            const std::string a = RandomDomainName(generator);
+            const std::string b = RandomDomainName(generator);
+            assert((DomainView(a) < DomainView(b)) == (Domain(a) < Domain(b)));
+            assert((DomainView(a) == DomainView(b)) == (Domain(a) == Domain(b)));
+            assert(DomainView(a).IsSubdomain(DomainView(b)) == Domain(a).IsSubdomain(Domain(b)));
+        }
+    }
+
+    void TestReadMappedDomains() {
+        using namespace std::literals;
+        const TempFile temp_file("task_2_test_domains_"sv);
+        const std::string& path = temp_file.Path();
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << " 2\nexample.com\n\n3\nsub.example.com\ngoogle.com\nexample.com"sv;
+        }
+        {
+            const MappedFile file(path);
+            std::string_view text = file.Data();
+            const std::vector<DomainView> forbidden_domains = ReadDomains(text, ReadNumberOnLine<size_t>(text));
+            assert(forbidden_domains == std::vector<DomainView>({ "example.com"sv, ""sv }));
+            const std::vector<DomainView> test_domains = ReadDomains(text, ReadNumberOnLine<size_t>(text));
+            assert(test_domains == std::vector<DomainView>({ "sub.example.com"sv, "google.com"sv, "example.com"sv }));
+            assert(text.empty());
+        }
+    }
+
+    // Сравниваем DomainTrie и DomainViewChecker с DomainChecker на случайных списках
+    void TestCheckersMatchDomainChecker() {
+        std::mt19937 generator(42);
+        for (int round = 0; round < 200; ++round) {
+            std::vector<std::string> names;
+            for (size_t count = generator() % 30; count > 0; --count) {
+                names.push_back(RandomDomainName(generator));
+            }
+            const std::vector<Domain> forbidden_domains(names.begin(), names.end());
+            const DomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+            const DomainTrie trie(forbidden_domains.begin(), forbidden_domains.end());
+            const DomainViewChecker view_checker(names.begin(), names.end());
+            for (int i = 0; i < 100; ++i) {
+                const std::string name = RandomDomainName(generator);
+                const Domain domain(name);
+                assert(checker.IsForbidden(domain) == trie.IsForbidden(domain));
+                assert(checker.IsForbidden(domain) == view_checker.IsForbidden(DomainView(name)));
+            }
+        }
+    }
+
+    void TestReloadableDomainChecker() {
+        {
+            const std::vector<Domain> forbidden_domains = { Domain("sub.example.com"), Domain("mail.google.com") };
+            ReloadableDomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+            assert(checker.IsForbidden(Domain("a.sub.example.com")));
+            assert(!checker.IsForbidden(Domain("example.com")));
+
+            // Изменения не видны до публикации
+            checker.Add(Domain("example.com"));
+            assert(!checker.IsForbidden(Domain("example.com")));
+            checker.Publish();
             assert(checker.IsForbidden(Domain("example.com")));
-            assert(!checker.IsForbidden(Domain("")));
-            assert(!checker.IsForbidden(Domain("subexample.com")));
-            assert(checker.IsForbidden(Domain("google.com")));
+            assert(checker.IsForbidden(Domain("other.example.com")));
+
+            // Явно перечисленный поддомен остается запрещенным после удаления родителя
+            checker.Remove(Domain("example.com"));
+            checker.Publish();
+            assert(!checker.IsForbidden(Domain("example.com")));
+            assert(!checker.IsForbidden(Domain("other.example.com")));
             assert(checker.IsForbidden(Domain("sub.example.com")));
-            assert(checker.IsForbidden(Domain("mail.google.com")));
-            assert(!checker.IsForbidden(Domain("example.org")));
-            assert(!checker.IsForbidden(Domain("m.example.org")));
-            assert(!checker.IsForbidden(Domain("google.org")));
-            assert(!checker.IsForbidden(Domain("test.org")));
+
+            // Удаление неперечисленного домена ничего не меняет
+            checker.Remove(Domain("google.com"));
+            checker.Remove(Domain("a.mail.google.com"));
+            checker.Publish();
+            assert(checker.IsForbidden(Domain("a.mail.google.com")));
         }
         {
-            // Тестируем пустой список запрещенных доменов
+            // Случайные изменения сравниваем с DomainChecker, построенным заново по всему списку
+            std::mt19937 generator(9);
+            const std::vector<Domain> empty;
+            ReloadableDomainChecker checker(empty.begin(), empty.end());
+            std::set<std::string> listed;
+            for (int i = 0; i < 2000; ++i) {
+                const std::string name = RandomDomainName(generator);
+                if (generator() % 3 == 0) {
+                    checker.Remove(Domain(name));
+                    listed.erase(name);
+                }
+                else {
+                    checker.Add(Domain(name));
+                    listed.insert(name);
+                }
+                if (i % 10 == 0) {
+                    checker.Publish();
+                    const DomainChecker expected(listed.begin(), listed.end());
+                    for (int j = 0; j < 20; ++j) {
+                        const Domain domain(RandomDomainName(generator));
+                        assert(checker.IsForbidden(domain) == expected.IsForbidden(domain));
+                    }
+                }
+            }
+        }
+    }
+
+    // Читатели проверяют домены, пока писатель меняет и публикует список
+    void TestReloadableDomainCheckerConcurrent() {
+        const std::vector<Domain> forbidden_domains = { Domain("com") };
+        ReloadableDomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+        std::atomic<bool> done = false;
+        std::vector<std::jthread> readers;
+        for (int t = 0; t < 3; ++t) {
+            readers.emplace_back([&checker, &done, t] {
+                std::mt19937 generator(t);
+                while (!done) {
+                    // "com" не удаляется, поэтому виден в любом снимке
+                    assert(checker.IsForbidden(Domain("example.com")));
+                    checker.IsForbidden(Domain(RandomDomainName(generator)));
+                }
+            });
+        }
+        std::mt19937 generator(100);
+        for (int i = 0; i < 1000; ++i) {
+            const Domain domain(RandomDomainName(generator));
+            if (domain == Domain("com")) {
+                continue;
+            }
+            if (i % 2 == 0) {
+                checker.Add(domain);
+            }
+            else {
+                checker.Remove(domain);
+            }
+            checker.Publish();
+        }
+        done = true;
+    }
+
+    void WriteFile(const std::string& path, std::string_view content) {
+        std::ofstream file(path, std::ios::binary);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+
+    // Открытие испорченного списка должно бросать исключение, а не читать за пределами файла
+    bool OpenFails(const std::string& path) {
+        try {
+            CompiledDomainChecker checker(path);
+        }
+        catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    }
+
+    // Файл открывается, но не проходит полную проверку. Поиск по нему при этом не должен
+    // читать за пределами файла (это ловит ASan)
+    bool VerifyFails(const std::string& path) {
+        const CompiledDomainChecker checker(path);
+        for (const char* name : { "a.com", "zzzz.zz", "", "ru" }) {
+            (void)checker.IsForbidden(Domain(name));
+        }
+        return !checker.Verify();
+    }
+
+    void TestCompiledDomainChecker() {
+        using namespace std::literals;
+        const TempFile temp_file("task_2_test_blocklist_"sv);
+        const std::string& path = temp_file.Path();
+        std::mt19937 generator(12);
+        std::string compiled_bytes;
+        for (size_t size : { size_t{ 0 }, size_t{ 1 }, size_t{ 50 } }) {
             std::vector<Domain> forbidden_domains;
-            DomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
-            assert(!checker.IsForbidden(Domain("example.com")));
-            assert(!checker.IsForbidden(Domain("")));
-            assert(!checker.IsForbidden(Domain("subexample.com")));
-            assert(!checker.IsForbidden(Domain("sub.example.com")));
+            for (size_t i = 0; i < size; ++i) {
+                forbidden_domains.emplace_back(RandomDomainName(generator));
+            }
+            std::ostringstream out;
+            CompiledDomainChecker::Compile(forbidden_domains.begin(), forbidden_domains.end(), out);
+            compiled_bytes = out.str();
+            WriteFile(path, compiled_bytes);
+            const CompiledDomainChecker compiled(path);
+            assert(compiled.Verify());
+            const DomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+            for (int i = 0; i < 200; ++i) {
+                const Domain domain(RandomDomainName(generator));
+                assert(compiled.IsForbidden(domain) == checker.IsForbidden(domain));
+            }
+        }
+
+        using Header = CompiledDomainChecker::BlocklistHeader;
+        Header header {};
+        std::memcpy(&header, compiled_bytes.data(), sizeof(header));
+        assert(header.domains_amount > 2);
+        // Записывает в файл собранный список, в котором по смещению offset подменено значение value
+        const auto write_patched = [&](size_t offset, auto value) {
+            std::string bytes = compiled_bytes;
+            std::memcpy(bytes.data() + offset, &value, sizeof(value));
+            WriteFile(path, bytes);
+        };
+        const auto offset_position = [](size_t index) {
+            return sizeof(Header) + index * sizeof(uint64_t);
+        };
+        // Порча имени открывается, но ловится контрольной суммой в Verify
+        write_patched(compiled_bytes.size() - 1, '#');
+        assert(VerifyFails(path));
+        // Порча заголовка
+        write_patched(offsetof(Header, version), uint32_t{ 2 });
+        assert(OpenFails(path));
+        // Обрезанный файл
+        WriteFile(path, std::string_view(compiled_bytes).substr(0, compiled_bytes.size() - 1));
+        assert(OpenFails(path));
+        WriteFile(path, std::string_view(compiled_bytes).substr(0, sizeof(Header) - 1));
+        assert(OpenFails(path));
+        {
+            // Размеры подобраны так, что sizeof(Header) + offsets_size + names_size переполняется
+            // и в сумме дает ровно размер файла
+            std::string bytes = compiled_bytes;
+            Header crafted = header;
+            crafted.domains_amount = (bytes.size() - sizeof(Header)) / sizeof(uint64_t);
+            crafted.names_size = bytes.size() - sizeof(Header) - (crafted.domains_amount + 1) * sizeof(uint64_t);
+            assert(sizeof(Header) + (crafted.domains_amount + 1) * sizeof(uint64_t) + crafted.names_size == bytes.size());
+            std::memcpy(bytes.data(), &crafted, sizeof(crafted));
+            WriteFile(path, bytes);
+            assert(OpenFails(path));
         }
+        // Убывающие смещения и смещение за пределами блока имен: файл открывается, поиск по нему
+        // не выходит за границы файла, а Verify его отвергает
+        uint64_t second_offset = 0;
+        std::memcpy(&second_offset, compiled_bytes.data() + offset_position(2), sizeof(second_offset));
+        write_patched(offset_position(1), second_offset + 1);
+        assert(VerifyFails(path));
+        write_patched(offset_position(1), header.names_size + 1);
+        assert(VerifyFails(path));
+        write_patched(offset_position(1), std::numeric_limits<uint64_t>::max());
+        assert(VerifyFails(path));
+        // Крайние смещения проверяются при открытии
+        write_patched(offset_position(0), uint64_t{ 1 });
+        assert(OpenFails(path));
+        write_patched(offset_position(header.domains_amount), header.names_size - 1);
+        assert(OpenFails(path));
+    }
+
+    void TestIsForbiddenBatch() {
+        std::mt19937 generator(8);
+        std::vector<Domain> forbidden_domains;
+        for (int i = 0; i < 30; ++i) {
+            forbidden_domains.emplace_back(RandomDomainName(generator));
+        }
+        const DomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+        const DomainTrie trie(forbidden_domains.begin(), forbidden_domains.end());
+
+        // Размеры вокруг границ кусков, чтобы проверить и неполный последний кусок
+        for (size_t size : { size_t{ 0 }, size_t{ 1 }, BATCH_CHUNK_SIZE - 1, BATCH_CHUNK_SIZE, 3 * BATCH_CHUNK_SIZE + 7 }) {
+            std::vector<Domain> domains;
+            std::vector<char> expected;
+            for (size_t i = 0; i < size; ++i) {
+                domains.emplace_back(RandomDomainName(generator));
+                expected.push_back(checker.IsForbidden(domains.back()));
+            }
+            for (unsigned threads_amount : {0u, 1u, 2u, 3u, 8u}) {
+                assert(IsForbiddenBatch(checker, std::span<const Domain>(domains), threads_amount) == expected);
+                assert(IsForbiddenBatch(trie, std::span<const Domain>(domains), threads_amount) == expected);
+            }
+        }
+    }
+
+    void TestWriteVerdicts() {
+        using namespace std::literals;
+        std::ostringstream out;
+        WriteVerdicts({ 1, 0, 0, 1 }, out);
+        assert(out.str() == "Bad\nGood\nGood\nBad\n"s);
     }
 }//!namespace tests
 
-int main() {
+//------------------------------------------------------
+//----------------------Benchmarks----------------------
+//------------------------------------------------------
+
+#include <chrono>
+#include <iomanip>
+
+namespace bench {
+
+    // Пропускная способность IsForbiddenBatch от 1 потока до числа ядер (но не меньше 4)
+    // на файле в формате stdin. Оба списка берутся из отображенного в память файла
+    void BatchScaling(const std::string& path, std::ostream& out) {
+        const MappedFile file(path);
+        std::string_view text = file.Data();
+        const std::vector<DomainView> forbidden_domains = ReadDomains(text, ReadNumberOnLine<size_t>(text));
+        const DomainViewChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+        const std::vector<DomainView> test_domains = ReadDomains(text, ReadNumberOnLine<size_t>(text));
+
+        const unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+        out << "threads\tMqueries/s\n";
+        for (unsigned threads_amount = 1; threads_amount <= max_threads; threads_amount *= 2) {
+            const auto start = std::chrono::steady_clock::now();
+            const std::vector<char> result = IsForbiddenBatch(checker, std::span<const DomainView>(test_domains), threads_amount);
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            out << threads_amount << '\t' << std::fixed << std::setprecision(2)
+                << result.size() / elapsed.count() / 1e6 << std::defaultfloat << '\n';
+        }
+    }
+}//!namespace bench
+
+// Читает оба списка из отображенного в память файла того же формата, что и stdin.
+// Домены не копируются: и список, и запросы ссылаются прямо на страницы файла
+void CheckMappedDomains(const std::string& path, std::ostream& out) {
+    const MappedFile file(path);
+    std::string_view text = file.Data();
+    const std::vector<DomainView> forbidden_domains = ReadDomains(text, ReadNumberOnLine<size_t>(text));
+    DomainViewChecker checker(forbidden_domains.begin(), forbidden_domains.end());
+
+    const std::vector<DomainView> test_domains = ReadDomains(text, ReadNumberOnLine<size_t>(text));
+    WriteVerdicts(IsForbiddenBatch(checker, std::span<const DomainView>(test_domains)), out);
+}
+
+// Собирает двоичный список из запрещенных доменов в текстовом формате stdin (только первая часть входа)
+void CompileBlocklist(std::istream& in, const std::string& path) {
+    const std::vector<Domain> forbidden_domains = ReadDomains(in, ReadNumberOnLine<size_t>(in));
+    std::ofstream out(path, std::ios::binary);
+    CompiledDomainChecker::Compile(forbidden_domains.begin(), forbidden_domains.end(), out);
+    if (!out.flush()) {
+        throw std::runtime_error(path + ": failed to write blocklist");
+    }
+    out.close();
+    if (!CompiledDomainChecker(path).Verify()) {
+        throw std::runtime_error(path + ": written blocklist does not verify");
+    }
+}
+
+// Полная проверка собранного списка. Возвращает false и пишет причину, если файл испорчен
+bool VerifyBlocklist(const std::string& path, std::ostream& out) {
+    if (!CompiledDomainChecker(path).Verify()) {
+        out << path << ": blocklist offsets or checksum are corrupted\n";
+        return false;
+    }
+    out << path << ": OK\n";
+    return true;
+}
+
+// Отвечает на запросы из stdin (кол-во и домены) по заранее собранному двоичному списку
+void CheckDomainsWithBlocklist(const std::string& path, std::istream& in, std::ostream& out) {
+    const CompiledDomainChecker checker(path);
+    const std::vector<Domain> test_domains = ReadDomains(in, ReadNumberOnLine<size_t>(in));
+    WriteVerdicts(IsForbiddenBatch(checker, std::span<const Domain>(test_domains)), out);
+}
+
+// Читает список запрещенных доменов и отвечает на запросы с помощью выбранной реализации проверки
+template <typename Checker>
+void CheckDomains(std::istream& in, std::ostream& out) {
+    const std::vector<Domain> forbidden_domains = ReadDomains(in, ReadNumberOnLine<size_t>(in));
+    Checker checker(forbidden_domains.begin(), forbidden_domains.end());
+
+    const std::vector<Domain> test_domains = ReadDomains(in, ReadNumberOnLine<size_t>(in));
+    WriteVerdicts(IsForbiddenBatch(checker, std::span<const Domain>(test_domains)), out);
+}
+
+int main(int argc, char* argv[]) {
     using namespace std::literals;
+    // stdio здесь не используется. Без синхронизации с ним cin читает через собственный буфер,
+    // а не через getc, который после запуска первого потока (в тестах) берет блокировку на каждый символ
+    std::ios::sync_with_stdio(false);
     tests::TestDomain();
-    tests::TestDomainChecker();
-    const std::vector<Domain> forbidden_domains = ReadDomains(std::cin, ReadNumberOnLine<size_t>(std::cin));
-    DomainChecker checker(forbidden_domains.begin(), forbidden_domains.end());
-
-    const std::vector<Domain> test_domains = ReadDomains(std::cin, ReadNumberOnLine<size_t>(std::cin));
-    for (const Domain& domain : test_domains) {
-        std::cout << (checker.IsForbidden(domain) ? "Bad"sv : "Good"sv) << std::endl;
+    tests::TestDomainChecker<DomainChecker>();
+    tests::TestDomainChecker<DomainTrie>();
+    tests::TestDomainChecker<DomainViewChecker, DomainView>();
+    tests::TestDomainView();
+    tests::TestReadMappedDomains();
+    tests::TestCheckersMatchDomainChecker();
+    tests::TestReloadableDomainChecker();
+    tests::TestReloadableDomainCheckerConcurrent();
+    tests::TestCompiledDomainChecker();
+    tests::TestIsForbiddenBatch();
+    tests::TestWriteVerdicts();
+    if (argc > 1 && argv[1] == "--trie"sv) {
+        CheckDomains<DomainTrie>(std::cin, std::cout);
+    }
+    else if (argc > 2 && argv[1] == "--mmap"sv) {
+        CheckMappedDomains(argv[2], std::cout);
+    }
+    else if (argc > 2 && argv[1] == "--compile"sv) {
+        CompileBlocklist(std::cin, argv[2]);
+    }
+    else if (argc > 2 && argv[1] == "--verify"sv) {
+        return VerifyBlocklist(argv[2], std::cout) ? 0 : 1;
+    }
+    else if (argc > 2 && argv[1] == "--blocklist"sv) {
+        CheckDomainsWithBlocklist(argv[2], std::cin, std::cout);
+    }
+    else if (argc > 2 && argv[1] == "--bench-batch"sv) {
+        bench::BatchScaling(argv[2], std::cout);
+    }
+    else {
+        CheckDomains<DomainChecker>(std::cin, std::cout);
     }
 }
\ No newline at end of file